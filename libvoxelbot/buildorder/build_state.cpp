@@ -2,10 +2,34 @@
 #include <libvoxelbot/utilities/mappings.h>
 #include <libvoxelbot/common/unit_lists.h>
 #include <libvoxelbot/utilities/predicates.h>
+#include <libvoxelbot/utilities/stdutils.h>
+#include <libvoxelbot/utilities/transposition_table.h>
 
 using namespace std;
 using namespace sc2;
 
+// Features for the Zobrist hash of a build state. High bits are set to keep them apart from the unit and event features.
+static const uint64_t ZobristRace = (1ULL << 63) | 1;
+static const uint64_t ZobristTime = (1ULL << 63) | 2;
+static const uint64_t ZobristMinerals = (1ULL << 63) | 3;
+static const uint64_t ZobristVespene = (1ULL << 63) | 4;
+static const uint64_t ZobristUpgrades = (1ULL << 63) | 5;
+static const uint64_t ZobristBaseMinerals = (1ULL << 63) | 6;
+static const uint64_t ZobristBaseVespene1 = (1ULL << 63) | 7;
+static const uint64_t ZobristBaseVespene2 = (1ULL << 63) | 8;
+
+/** Zobrist key of an entry in BuildState::units. Empty entries have a zero key so that they do not affect the hash. */
+static uint64_t unitKey(const BuildUnitInfo& u) {
+    if (u.units == 0 && u.busyUnits == 0) return 0;
+    return zobristKey(((uint64_t)u.type << 32) | (uint32_t)u.addon, ((uint64_t)(uint32_t)u.units << 32) | (uint32_t)u.busyUnits);
+}
+
+/** Zobrist key of an entry in BuildState::events. The time is quantized to milliseconds. */
+static uint64_t eventKey(const BuildEvent& ev) {
+    uint64_t feature = zobristKey(((uint64_t)ev.type << 32) | (uint32_t)ev.ability, ((uint64_t)ev.caster << 32) | (uint32_t)ev.casterAddon);
+    return zobristKey(feature, (uint64_t)llround(ev.time * 1000));
+}
+
 BuildState::BuildState(std::vector<std::pair<sc2::UNIT_TYPEID, int>> unitCounts) {
     assert(unitCounts.size() > 0);
     race = getUnitData(unitCounts[0].first).race;
@@ -164,7 +188,7 @@ void BuildState::transitionToWarpgates (const function<void(const BuildEvent&)>*
     for (auto& u : units) {
         if (u.type == UNIT_TYPEID::PROTOSS_GATEWAY && u.busyUnits < u.units) {
             int delta = u.units - u.busyUnits;
-            u.units -= delta;
+            modifyUnit(u, -delta, 0);
             assert(u.units >= 0);
             assert(u.availableUnits() >= 0);
             addUnits(UNIT_TYPEID::PROTOSS_WARPGATE, delta);
@@ -191,7 +215,7 @@ void BuildState::makeUnitsBusy(UNIT_TYPEID type, UNIT_TYPEID addon, int delta) {
 
     for (auto& u : units) {
         if (u.type == type && u.addon == addon) {
-            u.busyUnits += delta;
+            modifyUnit(u, 0, delta);
             assert(u.availableUnits() >= 0);
             assert(u.busyUnits >= 0);
 
@@ -214,7 +238,7 @@ void BuildState::addUnits(UNIT_TYPEID type, UNIT_TYPEID addon, int delta) {
 
     for (auto& u : units) {
         if (u.type == type && u.addon == addon) {
-            u.units += delta;
+            modifyUnit(u, delta, 0);
             if (u.availableUnits() < 0) {
                 cout << "Buggy units? " << UnitTypeToName(u.type) << " " << u.availableUnits() << " " << u.units << " " << u.busyUnits << endl;
             }
@@ -225,6 +249,7 @@ void BuildState::addUnits(UNIT_TYPEID type, UNIT_TYPEID addon, int delta) {
 
     if (delta > 0) {
         units.emplace_back(type, addon, delta);
+        unitsAndEventsKey += unitKey(units.back());
     } else {
         cerr << "Cannot remove " << UnitTypeToName(type) << endl;
         assert(false);
@@ -239,7 +264,7 @@ void BuildState::killUnits(UNIT_TYPEID type, UNIT_TYPEID addon, int count) {
 
     for (auto& u : units) {
         if (u.type == type && u.addon == addon) {
-            u.units -= count;
+            modifyUnit(u, -count, 0);
             assert(u.units >= 0);
             while(u.availableUnits() < 0) {
                 bool found = false;
@@ -249,8 +274,11 @@ void BuildState::killUnits(UNIT_TYPEID type, UNIT_TYPEID addon, int count) {
                         // This event is guaranteed to keep a unit busy
                         // Let's erase the event to free the unit for other work
                         // Note that FinishedUnit events with caster==Probe do not keep the probe busy: there will be a second MakeUnitAvailable event that marks the probe as busy for a shorter time
+                        unitsAndEventsKey -= eventKey(ev);
+                        removeCasterEventTimes(ev);
                         events.erase(events.begin() + i);
-                        u.busyUnits--;
+                        updateNextEconomicEventTime();
+                        modifyUnit(u, 0, -1);
                         found = true;
                         break;
                     }
@@ -261,7 +289,7 @@ void BuildState::killUnits(UNIT_TYPEID type, UNIT_TYPEID addon, int count) {
                     // Forcefully remove busy units.
                     // Usually they are occupied with some event, but in some cases they are just marked as busy.
                     // For example workers for a few seconds at the start of the game to simulate a delay.
-                    u.busyUnits--;
+                    modifyUnit(u, 0, -1);
                     cerr << "Forcefully removed busy unit " << UnitTypeToName(u.type) << " " << u.units << " " << u.busyUnits << " " << count << endl;
                     for (auto u : units) {
                         cerr << "Unit " << UnitTypeToName(u.type) << " " << u.units << "(-" << u.busyUnits << ")" << endl;
@@ -341,6 +369,13 @@ std::pair<bool, float> ChronoBoostInfo::useChronoBoost(float time) {
     return make_pair(false, 0);
 }
 
+// TODO: Check units here!
+static const float FasterSpeedMultiplier = 1.4f;
+static const float LowYieldMineralsPerMinute = 22 * FasterSpeedMultiplier;
+static const float HighYieldMineralsPerMinute = 40 * FasterSpeedMultiplier;
+static const float VespenePerMinute = 38 * FasterSpeedMultiplier;
+static const float MinutesPerSecond = 1 / 60.0f;
+
 MiningSpeed BuildState::miningSpeed() const {
     int harvesters = 0;
     int mules = 0;
@@ -387,13 +422,6 @@ MiningSpeed BuildState::miningSpeed() const {
     int highYieldHarvesters = min(highYieldMineralHarvestingSlots, mineralMining);
     int lowYieldHarvesters = min(lowYieldMineralHarvestingSlots, mineralMining - highYieldHarvesters);
 
-    // TODO: Check units here!
-    const float FasterSpeedMultiplier = 1.4f;
-    const float LowYieldMineralsPerMinute = 22 * FasterSpeedMultiplier;
-    const float HighYieldMineralsPerMinute = 40 * FasterSpeedMultiplier;
-    const float VespenePerMinute = 38 * FasterSpeedMultiplier;
-    const float MinutesPerSecond = 1 / 60.0f;
-
     MiningSpeed speed;
     // cout << mineralMining << " " << highYieldHarvesters << " " << lowYieldHarvesters << " " << foodAvailable() << endl;
     speed.mineralsPerSecond = (lowYieldHarvesters * LowYieldMineralsPerMinute + highYieldHarvesters * HighYieldMineralsPerMinute) * MinutesPerSecond;
@@ -402,6 +430,35 @@ MiningSpeed BuildState::miningSpeed() const {
     return speed;
 }
 
+MiningSpeed BuildState::saturatedMiningSpeed() const {
+    int bases = 0;
+    for (auto& unit : units) {
+        if (isTownHall(unit.type)) bases += unit.units;
+    }
+    for (auto& ev : events) {
+        if (ev.type == BuildEventType::FinishedUnit && isTownHall(abilityToUnit(ev.ability))) bases++;
+    }
+
+    int highYieldHarvesters = 0;
+    int lowYieldHarvesters = 0;
+    for (int i = 0; i < bases; i++) {
+        if (i < (int)baseInfos.size()) {
+            auto t = baseInfos[i].mineralSlots();
+            highYieldHarvesters += t.first;
+            lowYieldHarvesters += t.second;
+        } else {
+            highYieldHarvesters += 16;
+            lowYieldHarvesters += 8;
+        }
+    }
+
+    MiningSpeed speed;
+    speed.mineralsPerSecond = (lowYieldHarvesters * LowYieldMineralsPerMinute + highYieldHarvesters * HighYieldMineralsPerMinute) * MinutesPerSecond;
+    // 2 geysers per base with 3 harvesters each
+    speed.vespenePerSecond = bases * 2 * 3 * VespenePerMinute * MinutesPerSecond;
+    return speed;
+}
+
 float BuildState::timeToGetResources(MiningSpeed miningSpeed, float mineralCost, float vespeneCost) const {
     mineralCost -= resources.minerals;
     vespeneCost -= resources.vespene;
@@ -420,9 +477,116 @@ float BuildState::timeToGetResources(MiningSpeed miningSpeed, float mineralCost,
 }
 
 void BuildState::addEvent(BuildEvent event) {
-    // TODO: Insertion sort or something
-    events.push_back(event);
-    sort(events.begin(), events.end());
+    // Insert after all events with the same time to keep the events sorted
+    events.insert(upper_bound(events.begin(), events.end(), event), event);
+    unitsAndEventsKey += eventKey(event);
+    addCasterEventTimes(event);
+    if (event.time < nextEconomicEventTime && event.impactsEconomy()) nextEconomicEventTime = event.time;
+}
+
+void BuildState::onEventsModified() {
+    unitsAndEventsKey = calculateUnitsAndEventsKey();
+    updateNextEconomicEventTime();
+    casterEventTimes.clear();
+    for (auto& ev : events) addCasterEventTimes(ev);
+}
+
+uint64_t BuildState::calculateUnitsAndEventsKey() const {
+    uint64_t key = 0;
+    for (auto& u : units) key += unitKey(u);
+    for (auto& ev : events) key += eventKey(ev);
+    return key;
+}
+
+void BuildState::modifyUnit(BuildUnitInfo& unit, int unitsDelta, int busyDelta) {
+    unitsAndEventsKey -= unitKey(unit);
+    unit.units += unitsDelta;
+    unit.busyUnits += busyDelta;
+    unitsAndEventsKey += unitKey(unit);
+}
+
+uint64_t BuildState::zobristHashWithoutTime() const {
+#if DEBUG
+    if (unitsAndEventsKey != calculateUnitsAndEventsKey()) {
+        cerr << "Incremental hash does not match the state, were units or events modified directly without calling onEventsModified?" << endl;
+        assert(false);
+    }
+#endif
+
+    // Keys are combined using addition rather than xor, otherwise two identical events would cancel each other out
+    uint64_t h = unitsAndEventsKey;
+    h += zobristKey(ZobristRace, (uint64_t)race);
+    h += zobristKey(ZobristMinerals, (uint64_t)(int64_t)resources.minerals);
+    h += zobristKey(ZobristVespene, (uint64_t)(int64_t)resources.vespene);
+    h += zobristKey(ZobristUpgrades, upgrades.hash());
+    for (size_t i = 0; i < baseInfos.size(); i++) {
+        auto& base = baseInfos[i];
+        h += zobristKey(zobristKey(ZobristBaseMinerals, i), (uint64_t)(int64_t)base.remainingMinerals);
+        h += zobristKey(zobristKey(ZobristBaseVespene1, i), (uint64_t)(int64_t)base.remainingVespene1);
+        h += zobristKey(zobristKey(ZobristBaseVespene2, i), (uint64_t)(int64_t)base.remainingVespene2);
+    }
+    return h;
+}
+
+uint64_t BuildState::zobristHash() const {
+    return zobristHashWithoutTime() + zobristKey(ZobristTime, (uint64_t)llround(time * 1000));
+}
+
+void BuildState::updateNextEconomicEventTime() {
+    nextEconomicEventTime = numeric_limits<float>::infinity();
+    for (auto& ev : events) {
+        if (ev.impactsEconomy()) {
+            nextEconomicEventTime = ev.time;
+            break;
+        }
+    }
+}
+
+/** Calls fn for every unit type that the event may make available for casting, or once with UNIT_TYPEID::INVALID if it may make any unit available */
+template<class Fn>
+static void forEachCasterMadeAvailable(const BuildEvent& ev, Fn fn) {
+    switch (ev.type) {
+        case FinishedUnit:
+        case FinishedUpgrade:
+        case MakeUnitAvailable: {
+            // Either the caster of the event becomes free, or the event creates a new caster (this also covers addons which are added to the caster)
+            UNIT_TYPEID created = abilityToUnit(ev.ability);
+            if (ev.caster != UNIT_TYPEID::INVALID) fn(ev.caster);
+            if (created != UNIT_TYPEID::INVALID && created != ev.caster) fn(created);
+            break;
+        }
+        default:
+            fn(UNIT_TYPEID::INVALID);
+            break;
+    }
+}
+
+void BuildState::addCasterEventTimes(const BuildEvent& event) {
+    forEachCasterMadeAvailable(event, [&](UNIT_TYPEID type) {
+        auto entry = make_pair(type, event.time);
+        casterEventTimes.insert(upper_bound(casterEventTimes.begin(), casterEventTimes.end(), entry), entry);
+    });
+}
+
+void BuildState::removeCasterEventTimes(const BuildEvent& event) {
+    forEachCasterMadeAvailable(event, [&](UNIT_TYPEID type) {
+        auto entry = make_pair(type, event.time);
+        auto it = lower_bound(casterEventTimes.begin(), casterEventTimes.end(), entry);
+        assert(it != casterEventTimes.end() && *it == entry);
+        casterEventTimes.erase(it);
+    });
+}
+
+float BuildState::nextCasterEventTime(ABILITY_ID ability) const {
+    float result = numeric_limits<float>::infinity();
+    auto firstEventTime = [&](UNIT_TYPEID type) {
+        auto it = lower_bound(casterEventTimes.begin(), casterEventTimes.end(), make_pair(type, -numeric_limits<float>::infinity()));
+        if (it != casterEventTimes.end() && it->first == type) result = min(result, it->second);
+    };
+
+    firstEventTime(UNIT_TYPEID::INVALID);
+    for (auto caster : abilityToCasterUnit(ability)) firstEventTime(caster);
+    return result;
 }
 
 // All actions up to and including the end time will have been completed
@@ -443,6 +607,10 @@ void BuildState::simulate(float endTime, const function<void(const BuildEvent&)>
         }
 
         events.erase(events.begin());
+        unitsAndEventsKey -= eventKey(ev);
+        removeCasterEventTimes(ev);
+        // The economic event index only has to be updated when that event is popped (it is always the first one of its kind)
+        if (ev.time >= nextEconomicEventTime) updateNextEconomicEventTime();
         float dt = ev.time - time;
         currentMiningSpeed.simulateMining(*this, dt);
         time = ev.time;
@@ -507,13 +675,7 @@ bool BuildState::simulateBuildOrder(BuildOrderState& buildOrder, const function<
         if (item.chronoBoosted) buildOrder.lastChronoUnit = item.rawType();
 
         while (true) {
-            float nextSignificantEvent = numeric_limits<float>::infinity();
-            for (auto& ev : events) {
-                if (ev.impactsEconomy()) {
-                    nextSignificantEvent = ev.time;
-                    break;
-                }
-            }
+            float nextSignificantEvent = nextEconomicEventTime;
 
             bool isUnitAddon;
             int mineralCost, vespeneCost;
@@ -667,11 +829,16 @@ bool BuildState::simulateBuildOrder(BuildOrderState& buildOrder, const function<
                     return false;
                 }
 
-                if (events[0].time > maxTime) {
+                // Skip directly to the first event that can give us a caster.
+                // Events in between cannot change anything that would allow this item to be started, so there is no need to check after every one of them.
+                float casterEventTime = nextCasterEventTime(ability);
+                if (isinf(casterEventTime)) casterEventTime = events[0].time;
+
+                if (casterEventTime > maxTime) {
                     simulate(maxTime, eventCallback);
                     return true;
                 }
-                simulate(events[0].time, eventCallback);
+                simulate(casterEventTime, eventCallback);
                 continue;
             }
 
@@ -680,7 +847,7 @@ bool BuildState::simulateBuildOrder(BuildOrderState& buildOrder, const function<
             resources.vespene -= vespeneCost;
 
             // Mark the caster as being busy
-            casterUnit->busyUnits++;
+            modifyUnit(*casterUnit, 0, 1);
             assert(casterUnit->availableUnits() >= 0);
 
             if (casterUnit->type == UNIT_TYPEID::PROTOSS_WARPGATE) {
@@ -734,6 +901,101 @@ bool BuildState::simulateBuildOrder(BuildOrderState& buildOrder, const function<
     return true;
 }
 
+bool BuildState::simulateEconomy(float endTime) {
+    // Zerg workers and overlords are trained from larva, which this simplified loop doesn't model
+    if (race != Race::Protoss && race != Race::Terran) return false;
+
+    UNIT_TYPEID harvesterType = getHarvesterUnitForRace(race);
+    UNIT_TYPEID supplyType = getSupplyUnitForRace(race);
+    auto& harvesterData = getUnitData(harvesterType);
+    auto& supplyData = getUnitData(supplyType);
+    const float harvesterBuildTime = ticksToSeconds(harvesterData.build_time);
+    const float supplyBuildTime = ticksToSeconds(supplyData.build_time);
+
+    // Food is tracked incrementally instead of being recalculated from all units and events for every item.
+    // Food that will be available in the future only changes when we start new items.
+    // The currently available food can only increase when events complete, so the tracked value is a lower bound that is recalculated when it is not enough.
+    float foodInFuture = foodAvailableInFuture();
+    float foodNow = foodAvailable();
+
+    while (time < endTime) {
+        bool buildSupply = foodInFuture <= 2;
+        auto& data = buildSupply ? supplyData : harvesterData;
+        float mineralCost = data.mineral_cost;
+        ABILITY_ID ability = data.ability_id;
+
+        while (true) {
+            if (!buildSupply && foodNow < harvesterData.food_required) foodNow = foodAvailable();
+            if (!buildSupply && foodNow < harvesterData.food_required) {
+                if (events.empty()) return true;
+                simulate(min(endTime, events[0].time));
+                if (time >= endTime) return true;
+                continue;
+            }
+
+            // The income is constant until the next economic event, so we can skip straight to the point where the item is affordable
+            float eventTime = time + timeToGetResources(miningSpeed(), mineralCost, 0);
+            if (eventTime > nextEconomicEventTime && nextEconomicEventTime <= endTime) {
+                simulate(nextEconomicEventTime);
+                continue;
+            }
+
+            if (eventTime > endTime) {
+                simulate(endTime);
+                return true;
+            }
+
+            // No income and nothing that will change that
+            if (isinf(eventTime)) return true;
+
+            simulate(eventTime);
+
+            BuildUnitInfo* casterUnit = nullptr;
+            for (UNIT_TYPEID caster : abilityToCasterUnit(ability)) {
+                for (auto& casterCandidate : units) {
+                    if (casterCandidate.type == caster && casterCandidate.availableUnits() > 0) {
+                        casterUnit = &casterCandidate;
+                        break;
+                    }
+                }
+                if (casterUnit != nullptr) break;
+            }
+
+            if (casterUnit == nullptr) {
+                if (events.empty()) return true;
+
+                float casterEventTime = nextCasterEventTime(ability);
+                if (isinf(casterEventTime)) casterEventTime = events[0].time;
+                simulate(min(endTime, casterEventTime));
+                if (time >= endTime) return true;
+                continue;
+            }
+
+            resources.minerals -= mineralCost;
+            modifyUnit(*casterUnit, 0, 1);
+
+            // Same as in simulateBuildOrder: an existing chrono boost on the caster will speed up the item
+            float buildTime = buildSupply ? supplyBuildTime : harvesterBuildTime;
+            pair<bool, float> chrono = chronoInfo.getChronoBoostEndTime(casterUnit->type, time);
+            if (chrono.first) buildTime = modifyBuildTimeWithChronoBoost(time, chrono.second, buildTime);
+
+            auto newEvent = BuildEvent(BuildEventType::FinishedUnit, time + buildTime, casterUnit->type, ability);
+            newEvent.casterAddon = casterUnit->addon;
+            newEvent.chronoEndTime = chrono.second;
+            addEvent(newEvent);
+            if (casterUnit->type == UNIT_TYPEID::PROTOSS_PROBE) {
+                addEvent(BuildEvent(BuildEventType::MakeUnitAvailable, time + 6, UNIT_TYPEID::PROTOSS_PROBE, ABILITY_ID::INVALID));
+            }
+
+            foodInFuture += data.food_provided - data.food_required;
+            foodNow -= data.food_required;
+            break;
+        }
+    }
+
+    return true;
+}
+
 float BuildState::foodCap() const {
     float totalSupply = 0;
     for (auto& unit : units) {
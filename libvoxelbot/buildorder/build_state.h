@@ -2,6 +2,7 @@
 #include <vector>
 #include <cmath>
 #include <functional>
+#include <limits>
 #include "sc2api/sc2_interfaces.h"
 #include <iostream>
 #include <libvoxelbot/buildorder/build_order.h>
@@ -168,56 +169,75 @@ struct BuildState {
     CombatUpgrades upgrades;
 
 private:
-    mutable uint64_t cachedHash = 0;
+    /** Sum of the Zobrist keys of all #units and #events.
+     * Maintained incrementally whenever units or events are added, removed or modified.
+     */
+    uint64_t unitsAndEventsKey = 0;
+
+    /** Time of the first event in #events which impacts the economy, or infinity if there is no such event.
+     * Maintained by addEvent and when events are removed.
+     */
+    float nextEconomicEventTime = std::numeric_limits<float>::infinity();
+
+    /** Times of the events that may make a caster of a given unit type available, sorted by unit type and then by time.
+     * Events which may make a caster of any type available are stored with the type UNIT_TYPEID::INVALID.
+     * Maintained together with #events, so that #nextCasterEventTime only has to do a binary search for every possible caster.
+     * This is a single flat array rather than a map of heaps, since states are copied a lot and only have a few dozen events.
+     */
+    std::vector<std::pair<sc2::UNIT_TYPEID, float>> casterEventTimes;
+
+    /** Time of the first event that may make a caster for the given ability available, or infinity if there is no such event */
+    float nextCasterEventTime(sc2::ABILITY_ID ability) const;
+
+    void addCasterEventTimes(const BuildEvent& event);
+    void removeCasterEventTimes(const BuildEvent& event);
+
+    /** Changes the number of units and busy units of an entry in #units while keeping #unitsAndEventsKey up to date */
+    void modifyUnit(BuildUnitInfo& unit, int unitsDelta, int busyDelta);
+
+    /** Calculates #unitsAndEventsKey from scratch */
+    uint64_t calculateUnitsAndEventsKey() const;
+
+    void updateNextEconomicEventTime();
 public:
 
     BuildState() {}
     explicit BuildState(std::vector<std::pair<sc2::UNIT_TYPEID, int>> unitCounts);
     explicit BuildState(const sc2::ObservationInterface* observation, sc2::Unit::Alliance alliance, sc2::Race race, BuildResources resources, float time);
 
+    /** Returns the hash of the build state, same as #zobristHash */
     uint64_t hash() const {
-        cachedHash = 0;
-        return immutableHash();
+        return zobristHash();
     }
 
-        void recalculateHash() {
-        cachedHash = 0;
-        immutableHash();
+    /** Recalculates the hash from scratch.
+     * Must be called after #units or #events have been modified directly (without using e.g. #addUnits or #addEvent).
+     */
+    void recalculateHash() {
+        onEventsModified();
     }
 
+    /** Zobrist hash of the build state.
+     * This is cheap to calculate because the hash of the units and events is updated incrementally,
+     * only the resources, bases and upgrades are hashed on demand. Time and resources are quantized to milliseconds and whole resource units respectively.
+     * When compiled with DEBUG the incremental hash is verified against a full recalculation.
+     * The chrono boost state is not included.
+     */
+    uint64_t zobristHash() const;
+
+    /** Same as #zobristHash but without the current time.
+     * Two states with the same hash have the same units, events (at the same absolute times) and resources,
+     * so the one that reached that configuration first is at least as good as the other one.
+     */
+    uint64_t zobristHashWithoutTime() const;
+
     void transitionToWarpgates (const std::function<void(const BuildEvent&)>* eventCallback);
 
     /** Returns the hash of the build state.
-     * Note: Assumes the object is immutable, the hash is cached the first time the method is called
+     * Kept for compatibility, the hash is maintained incrementally so it no longer has to be cached.
      */
     uint64_t immutableHash() const {
-        if (cachedHash == 0) {
-            uint64_t h = 0;
-            h = h*31 ^ (int)(time * 1000);
-            h = h*31 ^ (int)(resources.minerals * 1000);
-            h = h*31 ^ (int)(resources.vespene * 1000);
-            h = h*31 ^ (int)(race);
-            for (auto& u : units) {
-                h = h*31 ^ (int)u.type;
-                h = h*31 ^ (int)u.addon;
-                h = h*31 ^ (int)u.busyUnits;
-                h = h*31 ^ (int)u.units;
-            }
-            for (auto& s : baseInfos) {
-                h = h*31 ^ ((int)s.remainingMinerals);
-                h = h*31 ^ ((int)s.remainingVespene1);
-                h = h*31 ^ ((int)s.remainingVespene2);
-            }
-            for (auto& e : events) {
-                h = h*31 ^ ((int)e.ability);
-                h = h*31 ^ ((int)e.caster);
-                h = h*31 ^ ((int)e.casterAddon);
-                h = h*31 ^ ((int)e.time);
-                h = h*31 ^ ((int)e.type); // Type is really implied by the ability, but oh well
-            }
-            cachedHash = h;
-        }
-        return cachedHash;
+        return zobristHash();
     }
 
     /** Marks a number of units with the given type (and optionally addon) as being busy.
@@ -240,12 +260,23 @@ public:
     /** Returns the current mining speed of (minerals,vespene gas) per second (at normal game speed) */
     MiningSpeed miningSpeed() const;
 
+    /** Returns the mining speed that the state would have if all bases (including the ones under construction) were fully saturated with harvesters.
+     * This is an upper bound on the mining speed as long as no new bases are started.
+     */
+    MiningSpeed saturatedMiningSpeed() const;
+
     /** Returns the time it will take to get the specified resources using the given mining speed */
     float timeToGetResources(MiningSpeed miningSpeed, float mineralCost, float vespeneCost) const;
 
-    /** Adds a new future event to the state */
+    /** Adds a new future event to the state.
+     * The event is inserted into the sorted #events vector, which is linear in the number of events. States only have a few dozen events,
+     * so this is cheaper than keeping them in a heap, which would also make iterating over them in order expensive.
+     */
     void addEvent(BuildEvent event);
 
+    /** Must be called after #units or #events have been modified directly (without using e.g. #addUnits or #addEvent) */
+    void onEventsModified();
+
     /** Simulate the state until a given point in time.
      * All actions up to and including the end time will have been completed after the function has been called.
      * This will update the current resources using the simulated mining speed.
@@ -263,6 +294,16 @@ public:
     bool simulateBuildOrder(const BuildOrder& buildOrder, const std::function<void(int)> = nullptr, bool waitUntilItemsFinished = true);
     bool simulateBuildOrder(BuildOrderState& buildOrder, const std::function<void(int)> callback, bool waitUntilItemsFinished, float maxTime = std::numeric_limits<float>::infinity(), const std::function<void(const BuildEvent&)>* eventCallback = nullptr);
 
+    /** Simulates the state until the given time while continuously training workers and building supply structures.
+     * A supply structure is built whenever 2 or less food will be available in the future, otherwise a worker is trained.
+     * This is equivalent to repeatedly calling #simulateBuildOrder with a single worker or supply structure,
+     * but it skips directly from one point where an item can be started to the next one, so it is a lot faster.
+     * Items that cannot be started before the end time are not started.
+     *
+     * Only Protoss and Terran are supported. For other races the function returns false and the state is not modified.
+     */
+    bool simulateEconomy(float endTime);
+
     float foodCap() const;
 
     /** Food that is currently available.
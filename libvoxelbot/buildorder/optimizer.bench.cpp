@@ -0,0 +1,313 @@
+/** Benchmarks for the build order simulator and optimizer.
+ *
+ * Runs a number of benchmarks on a small corpus of start states for each race and prints one JSON object per line with the results.
+ * Pass --quick to run fewer repetitions (useful to check that everything works).
+ */
+#include <libvoxelbot/buildorder/build_state.h>
+#include <libvoxelbot/buildorder/optimizer.h>
+#include <libvoxelbot/common/unit_lists.h>
+#include <libvoxelbot/utilities/mappings.h>
+#include <libvoxelbot/utilities/profiler.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <string>
+
+using namespace std;
+using namespace sc2;
+
+// Count all heap allocations made by the process, so that we can report the number of allocations per evaluation
+static atomic<uint64_t> allocationCount(0);
+
+void* operator new(size_t size) {
+    allocationCount++;
+    void* ptr = malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr) throw bad_alloc();
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+struct BenchmarkScenario {
+    string race;
+    string name;
+    BuildState state;
+    vector<pair<BuildOrderItem, int>> target;
+    /** A reasonable build order for the target, used for the benchmarks which evaluate a fixed build order */
+    BuildOrder buildOrder;
+};
+
+struct BenchmarkResult {
+    int evaluations = 0;
+    double totalMillis = 0;
+    uint64_t allocations = 0;
+    vector<double> latencies;
+};
+
+static BuildOrder targetToBuildOrder(const BuildState& state, const vector<pair<BuildOrderItem, int>>& target, int chronoBoostedItems) {
+    BuildOrder order;
+    for (auto& item : target) {
+        for (int i = 0; i < item.second; i++) order.items.push_back(item.first);
+    }
+    for (int i = 0; i < chronoBoostedItems && i < (int)order.size(); i++) order[i].chronoBoosted = true;
+
+    return expandBuildOrderWithImplicitSteps(state, order).first;
+}
+
+static BenchmarkScenario createScenario(string race, string name, vector<pair<UNIT_TYPEID, int>> units, int bases, float time, BuildResources resources, vector<pair<BuildOrderItem, int>> target, int chronoBoostedItems = 0, vector<UPGRADE_ID> upgrades = {}) {
+    BuildState state(units);
+    state.time = time;
+    state.resources = resources;
+    for (auto upgrade : upgrades) state.upgrades.add(upgrade);
+    for (int i = 0; i < bases; i++) state.baseInfos.push_back(BaseInfo(10800 - 1500 * i, 2250, 2250));
+    BuildOrder buildOrder = targetToBuildOrder(state, target, chronoBoostedItems);
+    return { race, name, state, target, buildOrder };
+}
+
+static vector<BenchmarkScenario> createScenarios() {
+    vector<BenchmarkScenario> scenarios;
+
+    // Protoss
+    scenarios.push_back(createScenario("protoss", "opening", {
+        { UNIT_TYPEID::PROTOSS_NEXUS, 1 },
+        { UNIT_TYPEID::PROTOSS_PROBE, 12 },
+    }, 1, 0, BuildResources(50, 0), {
+        { BuildOrderItem(UNIT_TYPEID::PROTOSS_STALKER), 2 },
+        { BuildOrderItem(UNIT_TYPEID::PROTOSS_ZEALOT), 2 },
+    }));
+    scenarios.push_back(createScenario("protoss", "midgame_3base", {
+        { UNIT_TYPEID::PROTOSS_NEXUS, 3 },
+        { UNIT_TYPEID::PROTOSS_PROBE, 50 },
+        { UNIT_TYPEID::PROTOSS_PYLON, 6 },
+        { UNIT_TYPEID::PROTOSS_ASSIMILATOR, 4 },
+        { UNIT_TYPEID::PROTOSS_GATEWAY, 4 },
+        { UNIT_TYPEID::PROTOSS_CYBERNETICSCORE, 1 },
+        { UNIT_TYPEID::PROTOSS_ROBOTICSFACILITY, 1 },
+        { UNIT_TYPEID::PROTOSS_STALKER, 6 },
+    }, 3, 360, BuildResources(300, 150), {
+        { BuildOrderItem(UNIT_TYPEID::PROTOSS_STALKER), 12 },
+        { BuildOrderItem(UNIT_TYPEID::PROTOSS_IMMORTAL), 3 },
+        { BuildOrderItem(UNIT_TYPEID::PROTOSS_OBSERVER), 1 },
+    }));
+    scenarios.push_back(createScenario("protoss", "lategame_chrono_warpgates", {
+        { UNIT_TYPEID::PROTOSS_NEXUS, 4 },
+        { UNIT_TYPEID::PROTOSS_PROBE, 66 },
+        { UNIT_TYPEID::PROTOSS_PYLON, 12 },
+        { UNIT_TYPEID::PROTOSS_ASSIMILATOR, 8 },
+        { UNIT_TYPEID::PROTOSS_WARPGATE, 8 },
+        { UNIT_TYPEID::PROTOSS_CYBERNETICSCORE, 1 },
+        { UNIT_TYPEID::PROTOSS_TWILIGHTCOUNCIL, 1 },
+        { UNIT_TYPEID::PROTOSS_FORGE, 1 },
+        { UNIT_TYPEID::PROTOSS_ROBOTICSFACILITY, 2 },
+        { UNIT_TYPEID::PROTOSS_ROBOTICSBAY, 1 },
+        { UNIT_TYPEID::PROTOSS_STALKER, 10 },
+        { UNIT_TYPEID::PROTOSS_COLOSSUS, 2 },
+    }, 4, 600, BuildResources(800, 400), {
+        { BuildOrderItem(UNIT_TYPEID::PROTOSS_ZEALOT), 12 },
+        { BuildOrderItem(UNIT_TYPEID::PROTOSS_STALKER), 16 },
+        { BuildOrderItem(UNIT_TYPEID::PROTOSS_COLOSSUS), 4 },
+        { BuildOrderItem(UPGRADE_ID::CHARGE), 1 },
+        { BuildOrderItem(UPGRADE_ID::PROTOSSGROUNDWEAPONSLEVEL1), 1 },
+    }, 6, { UPGRADE_ID::WARPGATERESEARCH }));
+
+    // Terran
+    scenarios.push_back(createScenario("terran", "opening", {
+        { UNIT_TYPEID::TERRAN_COMMANDCENTER, 1 },
+        { UNIT_TYPEID::TERRAN_SCV, 12 },
+    }, 1, 0, BuildResources(50, 0), {
+        { BuildOrderItem(UNIT_TYPEID::TERRAN_MARINE), 4 },
+        { BuildOrderItem(UNIT_TYPEID::TERRAN_REAPER), 1 },
+    }));
+    scenarios.push_back(createScenario("terran", "midgame_3base", {
+        { UNIT_TYPEID::TERRAN_COMMANDCENTER, 3 },
+        { UNIT_TYPEID::TERRAN_SCV, 50 },
+        { UNIT_TYPEID::TERRAN_SUPPLYDEPOT, 7 },
+        { UNIT_TYPEID::TERRAN_REFINERY, 4 },
+        { UNIT_TYPEID::TERRAN_BARRACKS, 3 },
+        { UNIT_TYPEID::TERRAN_FACTORY, 1 },
+        { UNIT_TYPEID::TERRAN_STARPORT, 1 },
+        { UNIT_TYPEID::TERRAN_MARINE, 12 },
+    }, 3, 360, BuildResources(300, 150), {
+        { BuildOrderItem(UNIT_TYPEID::TERRAN_MARINE), 16 },
+        { BuildOrderItem(UNIT_TYPEID::TERRAN_MARAUDER), 4 },
+        { BuildOrderItem(UNIT_TYPEID::TERRAN_SIEGETANK), 2 },
+        { BuildOrderItem(UNIT_TYPEID::TERRAN_MEDIVAC), 2 },
+    }));
+    scenarios.push_back(createScenario("terran", "lategame", {
+        { UNIT_TYPEID::TERRAN_COMMANDCENTER, 4 },
+        { UNIT_TYPEID::TERRAN_SCV, 66 },
+        { UNIT_TYPEID::TERRAN_SUPPLYDEPOT, 14 },
+        { UNIT_TYPEID::TERRAN_REFINERY, 8 },
+        { UNIT_TYPEID::TERRAN_BARRACKS, 5 },
+        { UNIT_TYPEID::TERRAN_FACTORY, 2 },
+        { UNIT_TYPEID::TERRAN_STARPORT, 2 },
+        { UNIT_TYPEID::TERRAN_ENGINEERINGBAY, 2 },
+        { UNIT_TYPEID::TERRAN_ARMORY, 1 },
+        { UNIT_TYPEID::TERRAN_MARINE, 30 },
+    }, 4, 600, BuildResources(800, 400), {
+        { BuildOrderItem(UNIT_TYPEID::TERRAN_MARINE), 20 },
+        { BuildOrderItem(UNIT_TYPEID::TERRAN_MARAUDER), 8 },
+        { BuildOrderItem(UNIT_TYPEID::TERRAN_SIEGETANK), 4 },
+        { BuildOrderItem(UNIT_TYPEID::TERRAN_THOR), 2 },
+        { BuildOrderItem(UNIT_TYPEID::TERRAN_MEDIVAC), 4 },
+    }));
+
+    // Zerg
+    scenarios.push_back(createScenario("zerg", "opening", {
+        { UNIT_TYPEID::ZERG_HATCHERY, 1 },
+        { UNIT_TYPEID::ZERG_DRONE, 12 },
+        { UNIT_TYPEID::ZERG_OVERLORD, 1 },
+        { UNIT_TYPEID::ZERG_LARVA, 3 },
+    }, 1, 0, BuildResources(50, 0), {
+        { BuildOrderItem(UNIT_TYPEID::ZERG_ZERGLING), 6 },
+        { BuildOrderItem(UNIT_TYPEID::ZERG_QUEEN), 1 },
+    }));
+    scenarios.push_back(createScenario("zerg", "midgame_3base", {
+        { UNIT_TYPEID::ZERG_HATCHERY, 3 },
+        { UNIT_TYPEID::ZERG_DRONE, 50 },
+        { UNIT_TYPEID::ZERG_OVERLORD, 8 },
+        { UNIT_TYPEID::ZERG_LARVA, 9 },
+        { UNIT_TYPEID::ZERG_QUEEN, 3 },
+        { UNIT_TYPEID::ZERG_EXTRACTOR, 4 },
+        { UNIT_TYPEID::ZERG_SPAWNINGPOOL, 1 },
+        { UNIT_TYPEID::ZERG_ROACHWARREN, 1 },
+    }, 3, 360, BuildResources(300, 150), {
+        { BuildOrderItem(UNIT_TYPEID::ZERG_ROACH), 12 },
+        { BuildOrderItem(UNIT_TYPEID::ZERG_ZERGLING), 8 },
+    }));
+    scenarios.push_back(createScenario("zerg", "lategame", {
+        { UNIT_TYPEID::ZERG_HATCHERY, 3 },
+        { UNIT_TYPEID::ZERG_LAIR, 1 },
+        { UNIT_TYPEID::ZERG_DRONE, 66 },
+        { UNIT_TYPEID::ZERG_OVERLORD, 16 },
+        { UNIT_TYPEID::ZERG_LARVA, 12 },
+        { UNIT_TYPEID::ZERG_QUEEN, 4 },
+        { UNIT_TYPEID::ZERG_EXTRACTOR, 8 },
+        { UNIT_TYPEID::ZERG_SPAWNINGPOOL, 1 },
+        { UNIT_TYPEID::ZERG_ROACHWARREN, 1 },
+        { UNIT_TYPEID::ZERG_HYDRALISKDEN, 1 },
+        { UNIT_TYPEID::ZERG_EVOLUTIONCHAMBER, 2 },
+    }, 4, 600, BuildResources(800, 400), {
+        { BuildOrderItem(UNIT_TYPEID::ZERG_ROACH), 16 },
+        { BuildOrderItem(UNIT_TYPEID::ZERG_HYDRALISK), 12 },
+    }));
+
+    return scenarios;
+}
+
+template <class Fn>
+static BenchmarkResult runBenchmark(int evaluations, Fn fn) {
+    BenchmarkResult result;
+    result.evaluations = evaluations;
+    result.latencies.reserve(evaluations);
+
+    // Warm up caches
+    fn();
+
+    uint64_t allocationsBefore = allocationCount;
+    for (int i = 0; i < evaluations; i++) {
+        Stopwatch watch;
+        fn();
+        watch.stop();
+        result.latencies.push_back(watch.millis());
+        result.totalMillis += watch.millis();
+    }
+    // Note: includes the allocations for the latency vector, but it has been reserved up front so that is zero
+    result.allocations = allocationCount - allocationsBefore;
+    return result;
+}
+
+static double percentile(vector<double> values, double p) {
+    if (values.empty()) return 0;
+    sort(values.begin(), values.end());
+    int index = min((int)values.size() - 1, (int)(p * values.size()));
+    return values[index];
+}
+
+static void report(const string& benchmark, const BenchmarkScenario& scenario, const BenchmarkResult& result) {
+    cout << "{"
+        << "\"benchmark\": \"" << benchmark << "\", "
+        << "\"race\": \"" << scenario.race << "\", "
+        << "\"state\": \"" << scenario.name << "\", "
+        << "\"evaluations\": " << result.evaluations << ", "
+        << "\"evals_per_sec\": " << (result.evaluations / (result.totalMillis / 1000.0)) << ", "
+        << "\"allocs_per_eval\": " << ((double)result.allocations / result.evaluations) << ", "
+        << "\"p50_ms\": " << percentile(result.latencies, 0.5) << ", "
+        << "\"p99_ms\": " << percentile(result.latencies, 0.99)
+        << "}" << endl;
+}
+
+/** Reports how long a single search took and how good the result was, to compare the search algorithms */
+static void reportSearchQuality(const string& algorithm, const BenchmarkScenario& scenario, double millis, const pair<BuildOrder, BuildOrderFitness>& result) {
+    cout << "{"
+        << "\"benchmark\": \"search_quality\", "
+        << "\"race\": \"" << scenario.race << "\", "
+        << "\"state\": \"" << scenario.name << "\", "
+        << "\"algorithm\": \"" << algorithm << "\", "
+        << "\"time_to_solution_ms\": " << millis << ", "
+        << "\"fitness_time\": " << result.second.time << ", "
+        << "\"fitness_score\": " << result.second.score() << ", "
+        << "\"build_order_size\": " << result.first.size()
+        << "}" << endl;
+}
+
+int main(int argc, char** argv) {
+    bool quick = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quick") == 0) quick = true;
+    }
+
+    initMappings();
+    auto scenarios = createScenarios();
+
+    int simulationEvaluations = quick ? 50 : 2000;
+    int fitnessEvaluations = quick ? 20 : 500;
+    int localOptimizationEvaluations = quick ? 2 : 20;
+    int geneticEvaluations = quick ? 1 : 5;
+
+    for (auto& scenario : scenarios) {
+        auto order = scenario.buildOrder;
+        report("simulateBuildOrder", scenario, runBenchmark(simulationEvaluations, [&]() {
+            BuildState state = scenario.state;
+            state.simulateBuildOrder(order);
+        }));
+
+        report("calculateFitness", scenario, runBenchmark(fitnessEvaluations, [&]() {
+            calculateFitness(scenario.state, order);
+        }));
+
+        report("locallyOptimizeGene", scenario, runBenchmark(localOptimizationEvaluations, [&]() {
+            locallyOptimizeBuildOrder(scenario.state, order, scenario.target);
+        }));
+
+        BuildOptimizerParams params;
+        params.seed = 1;
+        report("findBestBuildOrderGenetic", scenario, runBenchmark(geneticEvaluations, [&]() {
+            findBestBuildOrderGenetic(scenario.state, scenario.target, nullptr, params);
+        }));
+
+        BuildOptimizerParams beamParams;
+        beamParams.algorithm = BuildOptimizerAlgorithm::BeamSearch;
+        report("findBestBuildOrderBeamSearch", scenario, runBenchmark(geneticEvaluations, [&]() {
+            findBestBuildOrderGenetic(scenario.state, scenario.target, nullptr, beamParams);
+        }));
+
+        for (auto& search : { make_pair(string("genetic"), params), make_pair(string("beam_search"), beamParams) }) {
+            Stopwatch watch;
+            auto result = findBestBuildOrderGeneticWithFitness(scenario.state, scenario.target, nullptr, search.second);
+            watch.stop();
+            reportSearchQuality(search.first, scenario, watch.millis(), result);
+        }
+    }
+
+    return 0;
+}
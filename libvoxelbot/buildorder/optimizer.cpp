@@ -2,14 +2,22 @@
 #include <algorithm>
 #include <limits>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <random>
 #include <stack>
+#include <unordered_map>
 #include <iostream>
 #include <cmath>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
 #include <libvoxelbot/utilities/mappings.h>
 #include <libvoxelbot/utilities/predicates.h>
 #include <libvoxelbot/utilities/profiler.h>
 #include <libvoxelbot/utilities/stdutils.h>
+#include <libvoxelbot/utilities/thread_pool.h>
+#include <libvoxelbot/utilities/transposition_table.h>
 #include <libvoxelbot/common/unit_lists.h>
 #include <libvoxelbot/buildorder/tracker.h>
 #include <libvoxelbot/utilities/build_state_serialization.h>
@@ -136,26 +144,66 @@ static void traceDependencies(const vector<int>& unitCounts, const AvailableUnit
     }
 }
 
-/** Finalizes the gene's build order by adding in all implicit steps */
-BuildOrder addImplicitBuildOrderSteps(const vector<GeneUnitType>& buildOrder, Race race, float startingFood, const vector<int>& startingUnitCounts, const vector<int>& startingAddonCountPerUnitType, const AvailableUnitTypes& availableUnitTypes, vector<bool>* outIsOriginalItem = nullptr) {
-    vector<int> unitCounts = startingUnitCounts;
-    vector<int> addonCountPerUnitType = startingAddonCountPerUnitType;
-    assert(unitCounts.size() == availableUnitTypes.size());
-    BuildOrder finalBuildOrder;
-    float totalFood = startingFood;
-    UNIT_TYPEID currentSupplyUnit = getSupplyUnitForRace(race);
-    UNIT_TYPEID currentVespeneHarvester = getVespeneHarvesterForRace(race);
-    UNIT_TYPEID currentTownHall = getTownHallForRace(race);
+vector<BuildOrderItem> traceMissingDependencies(const vector<int>& unitCounts, const AvailableUnitTypes& availableUnitTypes, BuildOrderItem item) {
+    stack<BuildOrderItem> requirements;
+    if (item.isUnitType()) traceDependencies(unitCounts, availableUnitTypes, requirements, item.typeID());
+    else traceDependencies(unitCounts, availableUnitTypes, requirements, item.upgradeID());
 
-    // Note: stack always starts empty at each iteration, so it could be moved to inside the loop
-    // but having it outside avoids some allocations+deallocations.
+    vector<BuildOrderItem> result;
+    while (!requirements.empty()) {
+        result.push_back(requirements.top());
+        requirements.pop();
+    }
+    return result;
+}
+
+/** Adds implicit steps (supply, tech buildings, addons, etc.) to gene items one at a time.
+ * The state between two items is fully described by the unit counts, addon counts and the total food,
+ * which makes it possible to continue an expansion from a checkpoint.
+ */
+struct ImplicitStepsExpander {
+    const AvailableUnitTypes& availableUnitTypes;
+    vector<int> unitCounts;
+    vector<int> addonCountPerUnitType;
+    // Items that we have at least one of, used to quickly check if an item has any missing dependencies
+    AvailableUnitMask owned;
+    float totalFood;
+    UNIT_TYPEID currentSupplyUnit;
+    UNIT_TYPEID currentVespeneHarvester;
+    UNIT_TYPEID currentTownHall;
+
+    // Note: stack always starts empty for each item, so it could be a local variable
+    // but having it here avoids some allocations+deallocations.
     stack<BuildOrderItem> reqs;
 
-    for (GeneUnitType type : buildOrder) {
+    ImplicitStepsExpander(Race race, float startingFood, const vector<int>& startingUnitCounts, const vector<int>& startingAddonCountPerUnitType, const AvailableUnitTypes& availableUnitTypes)
+        : availableUnitTypes(availableUnitTypes), unitCounts(startingUnitCounts), addonCountPerUnitType(startingAddonCountPerUnitType), totalFood(startingFood) {
+        assert(unitCounts.size() == availableUnitTypes.size());
+        owned = availableUnitTypes.ownedMask(unitCounts);
+        currentSupplyUnit = getSupplyUnitForRace(race);
+        currentVespeneHarvester = getVespeneHarvesterForRace(race);
+        currentTownHall = getTownHallForRace(race);
+    }
+
+    void incrementCount(int index) {
+        unitCounts[index] += 1;
+        if (index < (int)owned.size()) owned[index] = true;
+    }
+
+    /** Appends the gene item and all of its implicit dependencies to the build order */
+    void addItem(GeneUnitType type, BuildOrder& finalBuildOrder, vector<bool>* outIsOriginalItem) {
         auto item = availableUnitTypes.getBuildOrderItem(type);
         reqs.push(item);
 
-        if (item.isUnitType()) {
+        if (availableUnitTypes.dependenciesSatisfied(type.type(), owned)) {
+            // Fast path: we already have everything needed for this item
+#if DEBUG
+            size_t stackSize = reqs.size();
+            if (item.isUnitType()) traceDependencies(unitCounts, availableUnitTypes, reqs, item.typeID());
+            else traceDependencies(unitCounts, availableUnitTypes, reqs, item.upgradeID());
+            assert(reqs.size() == stackSize);
+#endif
+        } else if (item.isUnitType()) {
             UNIT_TYPEID unitType;
             unitType = item.typeID();
 
@@ -231,13 +279,14 @@ BuildOrder addImplicitBuildOrderSteps(const vector<GeneUnitType>& buildOrder, Ra
                         // Remove the previous unit if this is an upgrade (e.g. command center -> planetary fortress)
                         // However make sure not to do it for addons, as the original building is still kept in that case
                         unitCounts[idx]--;
+                        if (unitCounts[idx] == 0 && idx < (int)owned.size()) owned[idx] = false;
                     }
                 }
 
                 totalFood += foodDelta;
-                unitCounts[availableUnitTypes.getIndex(requirementUnitType)] += 1;
+                incrementCount(availableUnitTypes.getIndex(requirementUnitType));
             } else {
-                unitCounts[availableUnitTypes.getIndex(requirement.upgradeID())] += 1;
+                incrementCount(availableUnitTypes.getIndex(requirement.upgradeID()));
             }
             finalBuildOrder.items.push_back(requirement);
             reqs.pop();
@@ -245,10 +294,89 @@ BuildOrder addImplicitBuildOrderSteps(const vector<GeneUnitType>& buildOrder, Ra
             if (outIsOriginalItem != nullptr) outIsOriginalItem->push_back(reqs.empty());
         }
     }
+};
 
+/** Finalizes the gene's build order by adding in all implicit steps */
+BuildOrder addImplicitBuildOrderSteps(const vector<GeneUnitType>& buildOrder, Race race, float startingFood, const vector<int>& startingUnitCounts, const vector<int>& startingAddonCountPerUnitType, const AvailableUnitTypes& availableUnitTypes, vector<bool>* outIsOriginalItem = nullptr) {
+    ImplicitStepsExpander expander(race, startingFood, startingUnitCounts, startingAddonCountPerUnitType, availableUnitTypes);
+    BuildOrder finalBuildOrder;
+    for (GeneUnitType type : buildOrder) {
+        expander.addItem(type, finalBuildOrder, outIsOriginalItem);
+    }
     return finalBuildOrder;
 }
 
+/** Cached result of expanding a gene with implicit steps.
+ * A snapshot of the expander state is stored before every gene item, so that an expansion can be continued
+ * from the first item that differs when the gene has been mutated.
+ * The snapshots are stored in flat arrays to make it cheap to copy a prefix of them.
+ */
+struct ImplicitStepsCache {
+    // Inputs that the expansion was made with
+    vector<GeneUnitType> gene;
+    Race race;
+    float startingFood;
+    vector<int> startingUnitCounts;
+    vector<int> startingAddonCountPerUnitType;
+    const AvailableUnitTypes* availableUnitTypes;
+
+    BuildOrder buildOrder;
+
+    // Snapshot i is the state right before gene item i was expanded (the last one is the state after the whole gene has been expanded)
+    vector<int> checkpointUnitCounts;
+    vector<int> checkpointAddonCounts;
+    vector<float> checkpointFood;
+    vector<int> checkpointBuildOrderSize;
+
+    bool hasSameInputs(Race race, float startingFood, const vector<int>& startingUnitCounts, const vector<int>& startingAddonCountPerUnitType, const AvailableUnitTypes& availableUnitTypes) const {
+        return this->race == race && this->startingFood == startingFood && this->availableUnitTypes == &availableUnitTypes && this->startingUnitCounts == startingUnitCounts && this->startingAddonCountPerUnitType == startingAddonCountPerUnitType;
+    }
+
+    void addCheckpoint(const ImplicitStepsExpander& expander) {
+        checkpointUnitCounts.insert(checkpointUnitCounts.end(), expander.unitCounts.begin(), expander.unitCounts.end());
+        checkpointAddonCounts.insert(checkpointAddonCounts.end(), expander.addonCountPerUnitType.begin(), expander.addonCountPerUnitType.end());
+        checkpointFood.push_back(expander.totalFood);
+        checkpointBuildOrderSize.push_back(buildOrder.size());
+    }
+
+    /** Copies the inputs and everything up to right before the gene item with the given index from another cache.
+     * The expander is reset to the state at that point.
+     */
+    void copyPrefix(const ImplicitStepsCache& other, int index, ImplicitStepsExpander& expander) {
+        int n = expander.unitCounts.size();
+        race = other.race;
+        startingFood = other.startingFood;
+        startingUnitCounts = other.startingUnitCounts;
+        startingAddonCountPerUnitType = other.startingAddonCountPerUnitType;
+        availableUnitTypes = other.availableUnitTypes;
+        gene.assign(other.gene.begin(), other.gene.begin() + index);
+        buildOrder.items.assign(other.buildOrder.items.begin(), other.buildOrder.items.begin() + other.checkpointBuildOrderSize[index]);
+        checkpointUnitCounts.assign(other.checkpointUnitCounts.begin(), other.checkpointUnitCounts.begin() + (index + 1) * n);
+        checkpointAddonCounts.assign(other.checkpointAddonCounts.begin(), other.checkpointAddonCounts.begin() + (index + 1) * n);
+        checkpointFood.assign(other.checkpointFood.begin(), other.checkpointFood.begin() + index + 1);
+        checkpointBuildOrderSize.assign(other.checkpointBuildOrderSize.begin(), other.checkpointBuildOrderSize.begin() + index + 1);
+
+        copy(checkpointUnitCounts.end() - n, checkpointUnitCounts.end(), expander.unitCounts.begin());
+        copy(checkpointAddonCounts.end() - n, checkpointAddonCounts.end(), expander.addonCountPerUnitType.begin());
+        expander.totalFood = checkpointFood.back();
+        expander.owned = expander.availableUnitTypes.ownedMask(expander.unitCounts);
+    }
+};
+
+/** Samples an index in the range [0, size) from a normal distribution that is truncated to that range.
+ * Values outside the range are rejected. At least half of the probability mass is always inside the range when the standard deviation
+ * is at most size/4, so a few attempts are almost always enough, after that the value is clamped to the range.
+ */
+static int sampleTruncatedNormalIndex(float mean, float stddev, int size, default_random_engine& seed) {
+    normal_distribution<float> dist(mean, stddev);
+    int index = 0;
+    for (int attempt = 0; attempt < 16; attempt++) {
+        index = (int)round(dist(seed));
+        if (index >= 0 && index < size) return index;
+    }
+    return max(0, min(size - 1, index));
+}
+
 /** A gene represents a build order.
  * The build order may contain many implicit steps which will be added when the build order is finalized.
  * For example if any build item has any preconditions (e.g. training a marine requires a barracks which requires a supply depot, etc.) then when the build order is finalized any
@@ -266,9 +394,9 @@ struct BuildOrderGene {
     void validate(const vector<int>& actionRequirements) const {
         vector<int> remainingRequirements = actionRequirements;
         for (auto type : buildOrder)
-            remainingRequirements[type.type]--;
+            remainingRequirements[type.type()]--;
         for (auto r : remainingRequirements)
-            assert(r <= 0)
+            assert(r <= 0);
     }
 #else
     void validate(const vector<int>&) const {
@@ -279,45 +407,55 @@ struct BuildOrderGene {
      * Ensures that the build order will still create the units given by the action requirements.
      * 
      * The action requirements is a list as long as availableUnitTypes that specifies for each unit type how many that the build order should train/build.
+     *
+     * All moved items are taken out of the build order in a single pass and then merged back in at their new indices,
+     * so the cost is linear in the length of the build order (plus sorting the moved items).
      */
     void mutateMove(float amount, const vector<int>& actionRequirements, default_random_engine& seed) {
         validate(actionRequirements);
 
+#if DEBUG
+        int s = 0;
+        for (auto c : buildOrder)
+            s += c.type();
+#endif
+
+        int n = buildOrder.size();
         bernoulli_distribution shouldMutate(amount);
-        for (size_t i = 0; i < buildOrder.size(); i++) {
+        // Pairs of (new index, item) for all items that are moved
+        vector<pair<int, GeneUnitType>> moved;
+        vector<GeneUnitType> kept;
+        kept.reserve(n);
+        for (int i = 0; i < n; i++) {
             if (shouldMutate(seed)) {
-                normal_distribution<float> dist(i, buildOrder.size() * 0.25f);
-                while (true) {
-                    int moveIndex = (int)round(dist(seed));
-
-                    // Try again until we get a number in the right range
-                    if (moveIndex < 0 || moveIndex >= (int)buildOrder.size())
-                        continue;
+                moved.emplace_back(sampleTruncatedNormalIndex(i, n * 0.25f, n, seed), buildOrder[i]);
+            } else {
+                kept.push_back(buildOrder[i]);
+            }
+        }
 
-                    int s = 0;
-                    for (auto c : buildOrder)
-                        s += c.type;
+        if (!moved.empty()) {
+            // Stable to keep the original order of items that are moved to the same index
+            stable_sort(moved.begin(), moved.end(), [](const pair<int, GeneUnitType>& a, const pair<int, GeneUnitType>& b) { return a.first < b.first; });
 
-                    auto elem = buildOrder[i];
-                    // Move element i to the new position by pushing the elements in between one step
-                    if (moveIndex < (int)i) {
-                        for (int j = i; j > moveIndex; j--)
-                            buildOrder[j] = buildOrder[j - 1];
-                    } else {
-                        for (int j = i; j < moveIndex; j++)
-                            buildOrder[j] = buildOrder[j + 1];
-                    }
-                    buildOrder[moveIndex] = elem;
-
-                    int s2 = 0;
-                    for (auto c : buildOrder)
-                        s2 += c.type;
-                    assert(s == s2);
-                    break;
+            // Place each moved item at its new index, or right after the previous moved item if that index is already taken
+            size_t k = 0, j = 0;
+            for (int i = 0; i < n; i++) {
+                if (k < moved.size() && (moved[k].first <= i || j == kept.size())) {
+                    buildOrder[i] = moved[k++].second;
+                } else {
+                    buildOrder[i] = kept[j++];
                 }
             }
         }
 
+#if DEBUG
+        int s2 = 0;
+        for (auto c : buildOrder)
+            s2 += c.type();
+        assert(s == s2);
+#endif
+
         validate(actionRequirements);
     }
 
@@ -329,45 +467,92 @@ struct BuildOrderGene {
     void mutateAddRemove(float amount, default_random_engine& seed, const vector<int>& actionRequirements, const vector<int>& addableUnits, const AvailableUnitTypes& availableUnitTypes, bool allowChronoBoost) {
         vector<int> remainingRequirements = actionRequirements;
         for (size_t i = 0; i < buildOrder.size(); i++) {
-            remainingRequirements[buildOrder[i].type]--;
+            remainingRequirements[buildOrder[i].type()]--;
         }
 
-        // Remove elements randomly unless that violates the requirements
+        // Remove elements randomly unless that violates the requirements.
+        // Removed elements are marked with an invalid item first and then all of them are erased at once.
         bernoulli_distribution shouldRemove(amount);
         bernoulli_distribution shouldChrono(amount);
         bernoulli_distribution shouldRemoveChrono(0.4);
 
+        const GeneUnitType removedMarker;
         for (int i = (int)buildOrder.size() - 1; i >= 0; i--) {
-            if (remainingRequirements[buildOrder[i].type] < 0 && shouldRemove(seed)) {
+            if (remainingRequirements[buildOrder[i].type()] < 0 && shouldRemove(seed)) {
                 // Remove it!
-                remainingRequirements[buildOrder[i].type]++;
-                buildOrder.erase(buildOrder.begin() + i);
+                remainingRequirements[buildOrder[i].type()]++;
+                buildOrder[i] = removedMarker;
             }
         }
+        buildOrder.erase(remove(buildOrder.begin(), buildOrder.end(), removedMarker), buildOrder.end());
 
-        // Add elements randomly
+        auto updateChronoBoost = [&](GeneUnitType& item) {
+            if (allowChronoBoost) {
+                if (shouldChrono(seed) && availableUnitTypes.canBeChronoBoosted(item.type())) {
+                    item.setChronoBoosted(true);
+                } else if (item.chronoBoosted() && shouldRemoveChrono(seed)) {
+                    item.setChronoBoosted(false);
+                }
+            } else {
+                item.setChronoBoosted(false);
+            }
+        };
+
+        // Add elements randomly.
+        // Any number of elements may be added before each existing element, the new build order is written to a separate vector to avoid shifting elements.
         bernoulli_distribution shouldAdd(amount);
-        for (size_t i = 0; i < buildOrder.size(); i++) {
-            if (shouldAdd(seed)) {
+        vector<GeneUnitType> result;
+        result.reserve(buildOrder.size() + buildOrder.size() / 4 + 4);
+        for (auto item : buildOrder) {
+            while (shouldAdd(seed)) {
                 // Add something!
                 uniform_int_distribution<int> dist(0, addableUnits.size() - 1);
-                buildOrder.insert(buildOrder.begin() + i, GeneUnitType(addableUnits[dist(seed)]));
+                result.push_back(GeneUnitType(addableUnits[dist(seed)]));
+                updateChronoBoost(result.back());
             }
 
-            if (allowChronoBoost) {
-                if (shouldChrono(seed) && availableUnitTypes.canBeChronoBoosted(buildOrder[i].type)) {
-                    buildOrder[i].chronoBoosted = true;
-                } else if (buildOrder[i].chronoBoosted && shouldRemoveChrono(seed)) {
-                    buildOrder[i].chronoBoosted = false;
-                }
-            } else {
-                buildOrder[i].chronoBoosted = false;
+            result.push_back(item);
+            updateChronoBoost(result.back());
+        }
+        buildOrder.swap(result);
+
+        validate(actionRequirements);
+    }
+
+    /** Removes items that have already been completed and adds items for any requirements that are missing.
+     * For each unit type the first completedCounts[type] items of that type are removed, as those are the ones that would have been built first.
+     * Used when the start state has moved forward since the gene was created.
+     */
+    void dropCompletedItems(vector<int> completedCounts, const vector<int>& actionRequirements) {
+        vector<int> remainingRequirements = actionRequirements;
+        size_t j = 0;
+        for (size_t i = 0; i < buildOrder.size(); i++) {
+            auto item = buildOrder[i];
+            if (completedCounts[item.type()] > 0) {
+                completedCounts[item.type()]--;
+                continue;
+            }
+            remainingRequirements[item.type()]--;
+            buildOrder[j++] = item;
+        }
+        buildOrder.resize(j);
+
+        for (size_t i = 0; i < remainingRequirements.size(); i++) {
+            for (int k = 0; k < remainingRequirements[i]; k++) {
+                buildOrder.push_back(GeneUnitType(i));
             }
         }
 
         validate(actionRequirements);
     }
 
+    /** Hash of the items in the gene */
+    uint64_t hash() const {
+        uint64_t h = buildOrder.size();
+        for (auto item : buildOrder) h = splitmix64(h ^ item.code);
+        return h;
+    }
+
     BuildOrderGene()
         : buildOrder() {}
     
@@ -393,7 +578,7 @@ struct BuildOrderGene {
         for (auto u : seedBuildOrder.items) {
             auto item = availableUnitTypes.getGeneItem(u);
             buildOrder.push_back(item);
-            remainingRequirements[item.type]--;
+            remainingRequirements[item.type()]--;
         }
         for (size_t i = 0; i < remainingRequirements.size(); i++) {
             int r = remainingRequirements[i];
@@ -403,9 +588,48 @@ struct BuildOrderGene {
         }
     }
     
+    /** Expands the gene into a build order with all implicit steps added.
+     * The result is cached, and when the gene is mutated only the part after the first modified item is expanded again.
+     * The cache is shared between copies of the gene, so copying a gene does not copy the cache.
+     * Note: not safe to call concurrently on the same gene (but calling it on different genes is fine).
+     */
     BuildOrder constructBuildOrder(Race race, float startingFood, const vector<int>& startingUnitCounts, const vector<int>& startingAddonCountPerUnitType, const AvailableUnitTypes& availableUnitTypes) const {
-        return addImplicitBuildOrderSteps(buildOrder, race, startingFood, startingUnitCounts, startingAddonCountPerUnitType, availableUnitTypes);
+        size_t firstModified = 0;
+        if (expansionCache != nullptr && expansionCache->hasSameInputs(race, startingFood, startingUnitCounts, startingAddonCountPerUnitType, availableUnitTypes)) {
+            auto& cachedGene = expansionCache->gene;
+            firstModified = mismatch(buildOrder.begin(), buildOrder.begin() + min(buildOrder.size(), cachedGene.size()), cachedGene.begin()).first - buildOrder.begin();
+            if (firstModified == buildOrder.size() && firstModified == cachedGene.size()) return expansionCache->buildOrder;
+        }
+
+        ImplicitStepsExpander expander(race, startingFood, startingUnitCounts, startingAddonCountPerUnitType, availableUnitTypes);
+        auto cache = make_shared<ImplicitStepsCache>();
+        if (firstModified > 0) {
+            // Reuse the unmodified prefix. The old cache may be shared with other genes, so it must not be modified.
+            cache->copyPrefix(*expansionCache, firstModified, expander);
+        } else {
+            cache->race = race;
+            cache->startingFood = startingFood;
+            cache->startingUnitCounts = startingUnitCounts;
+            cache->startingAddonCountPerUnitType = startingAddonCountPerUnitType;
+            cache->availableUnitTypes = &availableUnitTypes;
+            cache->addCheckpoint(expander);
+        }
+
+        for (size_t i = firstModified; i < buildOrder.size(); i++) {
+            expander.addItem(buildOrder[i], cache->buildOrder, nullptr);
+            cache->gene.push_back(buildOrder[i]);
+            cache->addCheckpoint(expander);
+        }
+
+#if DEBUG
+        assert(cache->buildOrder.items == addImplicitBuildOrderSteps(buildOrder, race, startingFood, startingUnitCounts, startingAddonCountPerUnitType, availableUnitTypes).items);
+#endif
+        expansionCache = cache;
+        return cache->buildOrder;
     }
+
+private:
+    mutable shared_ptr<const ImplicitStepsCache> expansionCache;
 };
 
 int miningSpeedFutureColor = 0;
@@ -477,12 +701,19 @@ BuildOrderFitness calculateFitness(const BuildState& startState, const vector<in
     resources.minerals += miningSpeed.mineralsPerSecond * (time - state.time);
     resources.vespene += miningSpeed.vespenePerSecond * (time - state.time);
 
+    // Keep building workers and supply for a while to see how good the economy is.
+    // This has only ever built probes and pylons, so for the other races the loop below gives up at the first item.
+    // Only Protoss uses the fast path to keep the fitness (and thus the ranking) of build orders for the other races unchanged.
     float mineralEndTime = originalTime + 60;
-    while(state.time < mineralEndTime) {
-        if (state.foodAvailableInFuture() <= 2) {
-            if (!state.simulateBuildOrder({ UNIT_TYPEID::PROTOSS_PYLON }, nullptr, false)) break;
-        } else {
-            if (!state.simulateBuildOrder({ UNIT_TYPEID::PROTOSS_PROBE }, nullptr, false)) break;
+    if (state.race == Race::Protoss) {
+        state.simulateEconomy(mineralEndTime);
+    } else {
+        while(state.time < mineralEndTime) {
+            if (state.foodAvailableInFuture() <= 2) {
+                if (!state.simulateBuildOrder({ UNIT_TYPEID::PROTOSS_PYLON }, nullptr, false)) break;
+            } else {
+                if (!state.simulateBuildOrder({ UNIT_TYPEID::PROTOSS_PROBE }, nullptr, false)) break;
+            }
         }
     }
 
@@ -583,57 +814,91 @@ void printMiningSpeedFuture(const BuildState& startState) {
     // pybind11::module::import("matplotlib.pyplot").attr("scatter")(times, vespene);
 }
 
+/** A change to a gene tried by #locallyOptimizeGene */
+struct LocalGeneMove {
+    size_t index;
+    /** Remove the item at the index if true, otherwise swap it with the next item */
+    bool remove;
+    BuildOrderFitness fitness;
+
+    void apply(BuildOrderGene& gene) const {
+        if (remove) gene.buildOrder.erase(gene.buildOrder.begin() + index);
+        else swap(gene.buildOrder[index], gene.buildOrder[index + 1]);
+    }
+};
+
 /** Try really hard to do optimize the gene.
  * This will try to swap adjacent items in the build order as well as trying to remove all non-essential items.
+ *
+ * The moves are tried one after the other and each one is kept if it improves the fitness.
+ * With a pool the next few moves are evaluated in parallel on the current gene. Only the first one that is kept is applied,
+ * and the evaluations after it are thrown away as the gene has changed, so the result is the same as when running on a single thread.
  */
 // TODO: Add operation to remove all items that are implied anyway (i.e. if removing the item and then adding in implicit steps returns the same result as just adding in the implicit steps)
-BuildOrderGene locallyOptimizeGene(const BuildState& startState, const vector<int>& startingUnitCounts, const vector<int>& startingAddonCountPerUnitType, const AvailableUnitTypes& availableUnitTypes, const vector<int>& actionRequirements, const BuildOrderGene& gene) {
+BuildOrderGene locallyOptimizeGene(const BuildState& startState, const vector<int>& startingUnitCounts, const vector<int>& startingAddonCountPerUnitType, const AvailableUnitTypes& availableUnitTypes, const vector<int>& actionRequirements, const BuildOrderGene& gene, ThreadPool* pool = nullptr) {
     vector<int> currentActionRequirements = actionRequirements;
     for (auto b : gene.buildOrder)
-        currentActionRequirements[b.type]--;
+        currentActionRequirements[b.type()]--;
 
-    auto startFitness = calculateFitness(startState, startingUnitCounts, startingAddonCountPerUnitType, availableUnitTypes, gene);
-    auto fitness = startFitness;
+    auto fitness = calculateFitness(startState, startingUnitCounts, startingAddonCountPerUnitType, availableUnitTypes, gene);
     BuildOrderGene newGene = gene;
-    for (int i = 0; i < 2; i++) {
-        for (size_t j = 0; j < newGene.buildOrder.size(); j++) {
-            bool lastItem = j == newGene.buildOrder.size() - 1;
-            if (lastItem || newGene.buildOrder[j] != newGene.buildOrder[j + 1]) {
-                // Check if the item is non-essential
-                if (currentActionRequirements[newGene.buildOrder[j].type] < 0) {
-                    // Try removing
-                    auto orig = newGene.buildOrder[j];
-                    newGene.buildOrder.erase(newGene.buildOrder.begin() + j);
-
-                    auto newFitness = calculateFitness(startState, startingUnitCounts, startingAddonCountPerUnitType, availableUnitTypes, newGene);
-
-                    // Check if the new fitness is better
-                    // Also always remove non-essential items at the end of the build order
-                    // Note: !(a < b) == (a >= b)
-                    if (!(newFitness < fitness) || lastItem) {
-                        currentActionRequirements[orig.type] += 1;
-                        fitness = newFitness;
-                        j--;
-                        continue;
-                    } else {
-                        // Revert erase
-                        newGene.buildOrder.insert(newGene.buildOrder.begin() + j, orig);
-                    }
-                }
 
-                // Try swapping
-                if (j + 1 < newGene.buildOrder.size()) {
-                    swap(newGene.buildOrder[j], newGene.buildOrder[j + 1]);
-                    auto newFitness = calculateFitness(startState, startingUnitCounts, startingAddonCountPerUnitType, availableUnitTypes, newGene);
+    // Finds the first move at or after the given index, in the order that they are tried.
+    // Only the last item in a run of identical items is moved, and only non-essential items are removed.
+    auto findMove = [&](size_t index, bool remove, LocalGeneMove& move) {
+        for (; index < newGene.buildOrder.size(); index++, remove = true) {
+            bool lastItem = index == newGene.buildOrder.size() - 1;
+            if (!lastItem && newGene.buildOrder[index] == newGene.buildOrder[index + 1]) continue;
 
-                    if (fitness < newFitness) {
-                        fitness = newFitness;
-                    } else {
-                        // Revert swap
-                        swap(newGene.buildOrder[j], newGene.buildOrder[j + 1]);
-                    }
+            if (remove && currentActionRequirements[newGene.buildOrder[index].type()] < 0) {
+                move = { index, true, BuildOrderFitness::ReallyBad };
+                return true;
+            }
+            if (!lastItem) {
+                move = { index, false, BuildOrderFitness::ReallyBad };
+                return true;
+            }
+        }
+        return false;
+    };
+    auto findNextMove = [&](const LocalGeneMove& previous, LocalGeneMove& move) {
+        return previous.remove ? findMove(previous.index, false, move) : findMove(previous.index + 1, true, move);
+    };
+
+    int windowSize = pool != nullptr ? pool->size() : 1;
+    vector<LocalGeneMove> moves;
+    for (int i = 0; i < 2; i++) {
+        LocalGeneMove next;
+        bool hasNext = findMove(0, true, next);
+        while (hasNext) {
+            moves.clear();
+            moves.push_back(next);
+            while ((int)moves.size() < windowSize && findNextMove(moves.back(), next)) moves.push_back(next);
+
+            parallelFor(pool, moves.size(), [&](int k) {
+                BuildOrderGene candidate = newGene;
+                moves[k].apply(candidate);
+                moves[k].fitness = calculateFitness(startState, startingUnitCounts, startingAddonCountPerUnitType, availableUnitTypes, candidate);
+            });
+
+            bool applied = false;
+            for (auto& move : moves) {
+                // Check if the new fitness is better
+                // Also always remove non-essential items at the end of the build order
+                // Note: !(a < b) == (a >= b)
+                bool lastItem = move.index == newGene.buildOrder.size() - 1;
+                if (move.remove ? !(move.fitness < fitness) || lastItem : fitness < move.fitness) {
+                    if (move.remove) currentActionRequirements[newGene.buildOrder[move.index].type()] += 1;
+                    move.apply(newGene);
+                    fitness = move.fitness;
+                    // After a removal the item that took its place is tried next
+                    hasNext = move.remove ? findMove(move.index, true, next) : findMove(move.index + 1, true, next);
+                    applied = true;
+                    break;
                 }
             }
+
+            if (!applied) hasNext = findNextMove(moves.back(), next);
         }
     }
 
@@ -790,41 +1055,66 @@ pair<BuildOrder, vector<bool>> expandBuildOrderWithImplicitSteps (const BuildSta
     return { finalBuildOrder, partOfOriginalBuildOrder };
 }
 
+static_assert(sizeof(GeneUnitType) == sizeof(uint16_t), "Genes are compared as arrays of 16-bit integers");
+
+/** Number of leading items that are the same in both arrays, at most n */
+static int commonPrefixLength(const uint16_t* a, const uint16_t* b, int n) {
+    int i = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+    // Compare 8 items at a time
+    for (; i + 8 <= n; i += 8) {
+        __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+        int equalMask = _mm_movemask_epi8(_mm_cmpeq_epi16(va, vb));
+        if (equalMask != 0xFFFF) break;
+    }
+#endif
+    while (i < n && a[i] == b[i]) i++;
+    return i;
+}
+
 // https://siderite.blogspot.com/2007/01/super-fast-string-distance-algorithm.html
-float geneDistance(const BuildOrderGene& g1, const BuildOrderGene& g2) {
+float geneDistance(const BuildOrderGene& gene1, const BuildOrderGene& gene2) {
+    // GeneUnitType only contains the 16-bit code, so the genes can be compared as integer arrays
+    const uint16_t* g1 = reinterpret_cast<const uint16_t*>(gene1.buildOrder.data());
+    const uint16_t* g2 = reinterpret_cast<const uint16_t*>(gene2.buildOrder.data());
     int c = 0;
-	int offset1 = 0;
-	int offset2 = 0;
-	int dist = 0;
-    int l1 = g1.buildOrder.size();
-    int l2 = g2.buildOrder.size();
+    int offset1 = 0;
+    int offset2 = 0;
+    int dist = 0;
+    int l1 = gene1.buildOrder.size();
+    int l2 = gene2.buildOrder.size();
     const int maxOffset = 3;
-	while ((c + offset1 < l1) && (c + offset2 < l2)) {
-        if (g1.buildOrder[c + offset1] != g2.buildOrder[c + offset2]) {
-            offset1 = 0;
-            offset2 = 0;
-            bool found = false;
-            for (int i = 0; i < maxOffset; i++) {
-                if ((c + i < l1) && (g1.buildOrder[c + i] == g2.buildOrder[c])) {
-                    if (i > 0) {
-                        dist++;
-                        offset1 = i;
-                    }
-                    found = true;
-                    break;
+    while ((c + offset1 < l1) && (c + offset2 < l2)) {
+        if (g1[c + offset1] == g2[c + offset2]) {
+            // Skip past all equal items at once, genes are usually very similar
+            c += commonPrefixLength(&g1[c + offset1], &g2[c + offset2], min(l1 - c - offset1, l2 - c - offset2));
+            continue;
+        }
+
+        offset1 = 0;
+        offset2 = 0;
+        bool found = false;
+        for (int i = 0; i < maxOffset; i++) {
+            if ((c + i < l1) && (g1[c + i] == g2[c])) {
+                if (i > 0) {
+                    dist++;
+                    offset1 = i;
                 }
-                if ((c + i < l2) && (g1.buildOrder[c] == g2.buildOrder[c + i])) {
-                    if (i > 0) {
-                        dist++;
-                        offset2 = i;
-                    }
-                    found = true;
-                    break;
+                found = true;
+                break;
+            }
+            if ((c + i < l2) && (g1[c] == g2[c + i])) {
+                if (i > 0) {
+                    dist++;
+                    offset2 = i;
                 }
+                found = true;
+                break;
             }
-
-		    if (!found) dist++;
         }
+
+        if (!found) dist++;
         c++;
     }
     float fDist = dist + (l1 - offset1 + l2 - offset2) / 2 - c;
@@ -847,21 +1137,60 @@ BuildOrder findBestBuildOrderGenetic(const BuildState& startState, const vector<
     return findBestBuildOrderGeneticWithFitness(startState, target, seed, params).first;
 }
 
-std::pair<BuildOrder, BuildOrderFitness> findBestBuildOrderGeneticWithFitness(const BuildState& startState, const std::vector<std::pair<BuildOrderItem, int>>& target, const BuildOrder* seed, BuildOptimizerParams params) {
+/** Everything about the start state and the target that the optimizer needs.
+ * This is calculated once and then shared between all runs of the optimizer.
+ */
+struct BuildOptimizerProblem {
+    const BuildState& startState;
+    const AvailableUnitTypes& availableUnitTypes;
+    /** The start state simulated until all events have finished */
+    BuildState startStateAfterEvents;
+    vector<int> startingUnitCounts;
+    vector<int> startingAddonCountPerUnitType;
+    vector<int> actionRequirements;
+    vector<int> economicUnits;
+
+    BuildOptimizerProblem(const BuildState& startState, const AvailableUnitTypes& availableUnitTypes) : startState(startState), availableUnitTypes(availableUnitTypes) {}
+};
+
+/** Prepares the part of the problem that only depends on the start state. The target has to be set using #setBuildOptimizerTarget.
+ * If limitEconomy is true, no more bases are added once there are 8 of them and no more workers once there are 100.
+ */
+static BuildOptimizerProblem prepareBuildOptimizerProblem(const BuildState& startState, bool limitEconomy = false) {
     const AvailableUnitTypes& availableUnitTypes = getAvailableUnitsForRace(startState.race, UnitCategory::BuildOrderOptions);
     const AvailableUnitTypes& allEconomicUnits = getAvailableUnitsForRace(startState.race, UnitCategory::Economic);
+    BuildOptimizerProblem problem(startState, availableUnitTypes);
 
     // Simulate the starting state until all current events have finished, only then do we know which exact unit types the player will start with.
     // This is important for implicit dependencies in the build order.
     // If say a factory is under construction, we don't want to implictly build another factory if the build order specifies that a tank is supposed to be built.
-    BuildState startStateAfterEvents = startState;
-    startStateAfterEvents.simulate(startStateAfterEvents.time + 1000000);
+    problem.startStateAfterEvents = startState;
+    problem.startStateAfterEvents.simulate(problem.startStateAfterEvents.time + 1000000);
 
-    vector<int> startingUnitCounts;
-    vector<int> startingAddonCountPerUnitType;
-    tie(startingUnitCounts, startingAddonCountPerUnitType) = calculateStartingUnitCounts(startStateAfterEvents, availableUnitTypes);
+    tie(problem.startingUnitCounts, problem.startingAddonCountPerUnitType) = calculateStartingUnitCounts(problem.startStateAfterEvents, availableUnitTypes);
 
-    vector<int> actionRequirements(availableUnitTypes.size());
+    for (size_t i = 0; i < allEconomicUnits.size(); i++) {
+        if (limitEconomy) {
+            UNIT_TYPEID type = allEconomicUnits.getUnitType(i);
+            // Do not allow more than 8 bases (all the workers start to eat up the supply cap)
+            if (isTownHall(type) && problem.startingUnitCounts[availableUnitTypes.getIndex(getTownHallForRace(startState.race))] >= 8) continue;
+            // Do not allow more than 100 workers
+            if (isBasicHarvester(type) && problem.startingUnitCounts[availableUnitTypes.getIndex(getHarvesterUnitForRace(startState.race))] >= 100) continue;
+        }
+
+        problem.economicUnits.push_back(remapAvailableUnitIndex(i, allEconomicUnits, availableUnitTypes));
+    }
+
+    return problem;
+}
+
+/** Sets the action requirements of the problem to what is needed to reach the target from the start state */
+static void setBuildOptimizerTarget(BuildOptimizerProblem& problem, const vector<pair<BuildOrderItem, int>>& target) {
+    const AvailableUnitTypes& availableUnitTypes = problem.availableUnitTypes;
+    const BuildState& startStateAfterEvents = problem.startStateAfterEvents;
+
+    vector<int>& actionRequirements = problem.actionRequirements;
+    actionRequirements = vector<int>(availableUnitTypes.size());
     for (auto p : target) {
         int index = availableUnitTypes.getIndexMaybe(p.first.rawType());
         if (index != -1) {
@@ -883,22 +1212,112 @@ std::pair<BuildOrder, BuildOrderFitness> findBestBuildOrderGeneticWithFitness(co
             }
         }
     }
+}
 
-    vector<int> economicUnits;
-    for (size_t i = 0; i < allEconomicUnits.size(); i++) {
-        economicUnits.push_back(remapAvailableUnitIndex(i, allEconomicUnits, availableUnitTypes));
+static BuildOptimizerProblem prepareBuildOptimizerProblem(const BuildState& startState, const vector<pair<BuildOrderItem, int>>& target) {
+    BuildOptimizerProblem problem = prepareBuildOptimizerProblem(startState);
+    setBuildOptimizerTarget(problem, target);
+    return problem;
+}
+
+/** Fitness of genes that have been evaluated, indexed by BuildOrderGene::hash.
+ * Only valid as long as the start state and the available unit types stay the same. The fitness does not depend on the target,
+ * so runs for different targets from the same start state can share a cache. Several threads can use the cache at the same time.
+ * Cleared when it would grow beyond #MaxSize entries, the genes that survive for several generations are quickly added again.
+ */
+struct FitnessCache {
+    static const size_t MaxSize = 100000;
+
+    /** Copies the cached fitness of the genes with the given hashes, the indices of the genes that are not in the cache are added to missing */
+    void lookup(const vector<uint64_t>& hashes, vector<BuildOrderFitness>& fitness, vector<int>& missing) {
+        lock_guard<std::mutex> lock(mutex);
+        for (size_t j = 0; j < hashes.size(); j++) {
+            auto it = entries.find(hashes[j]);
+            if (it != entries.end()) {
+                fitness[j] = it->second;
+            } else {
+                missing.push_back(j);
+            }
+        }
     }
 
-    Stopwatch watch;
+    /** Adds the fitness of the genes with the given indices */
+    void insert(const vector<uint64_t>& hashes, const vector<BuildOrderFitness>& fitness, const vector<int>& indices) {
+        lock_guard<std::mutex> lock(mutex);
+        if (entries.size() + indices.size() > MaxSize) entries.clear();
+        for (int j : indices) entries[hashes[j]] = fitness[j];
+    }
+
+    void clear() {
+        lock_guard<std::mutex> lock(mutex);
+        entries.clear();
+    }
+
+private:
+    std::mutex mutex;
+    unordered_map<uint64_t, BuildOrderFitness> entries;
+};
+
+/** State of the evolutionary algorithm that can be carried over from one run to the next */
+struct GeneticOptimizerState {
+    /** Population at the end of the last run. If not empty the next run starts from this population instead of from random genes. */
+    vector<BuildOrderGene> population;
+    FitnessCache fitnessCache;
+};
+
+/** Runs the evolutionary algorithm once and returns the best gene that was found.
+ * All random numbers are taken from rnd, so for a given random state the result is deterministic regardless of the thread pool.
+ * If an optimizer state is given the run starts from its population, and the final population is stored in it afterwards.
+ */
+static pair<BuildOrderGene, BuildOrderFitness> runGeneticOptimizer(const BuildOptimizerProblem& problem, const BuildOrder* seed, const BuildOptimizerParams& params, default_random_engine& rnd, ThreadPool* pool, GeneticOptimizerState* optimizerState = nullptr, FitnessCache* sharedFitnessCache = nullptr) {
+    const BuildState& startState = problem.startState;
+    const AvailableUnitTypes& availableUnitTypes = problem.availableUnitTypes;
+    const vector<int>& startingUnitCounts = problem.startingUnitCounts;
+    const vector<int>& startingAddonCountPerUnitType = problem.startingAddonCountPerUnitType;
+    const vector<int>& actionRequirements = problem.actionRequirements;
+    const vector<int>& economicUnits = problem.economicUnits;
+
     float lastBestFitness = -100000000000;
 
-    vector<BuildOrderGene> generation(params.genePoolSize);
-    default_random_engine rnd(time(0));
-    // default_random_engine rnd(rand());
+    GeneticOptimizerState localState;
+    GeneticOptimizerState& state = optimizerState != nullptr ? *optimizerState : localState;
+    FitnessCache& fitnessCache = sharedFitnessCache != nullptr ? *sharedFitnessCache : state.fitnessCache;
+
+    vector<BuildOrderGene> generation = move(state.population);
+    generation.resize(params.genePoolSize);
     for (auto& gene : generation) {
-        gene = BuildOrderGene(rnd, actionRequirements);
+        if (gene.buildOrder.empty()) gene = BuildOrderGene(rnd, actionRequirements);
         gene.validate(actionRequirements);
     }
+
+    // The population is double buffered. The genes in the next generation are assigned to the genes from two generations ago,
+    // which reuses their memory instead of allocating new genes every generation.
+    vector<BuildOrderGene> nextGeneration;
+    int nextGenerationSize = 0;
+    auto addToNextGeneration = [&](const BuildOrderGene& gene) {
+        if (nextGenerationSize < (int)nextGeneration.size()) {
+            nextGeneration[nextGenerationSize] = gene;
+        } else {
+            nextGeneration.push_back(gene);
+        }
+        nextGenerationSize++;
+    };
+
+    // The best genes are carried over to the next generation without being mutated, so a lot of genes are seen several times.
+    // Those are looked up in the cache instead of being simulated again.
+    auto evaluateGeneration = [&](vector<BuildOrderFitness>& fitness) {
+        vector<uint64_t> hashes(generation.size());
+        vector<int> toEvaluate;
+        for (size_t j = 0; j < generation.size(); j++) hashes[j] = generation[j].hash();
+        fitnessCache.lookup(hashes, fitness, toEvaluate);
+
+        parallelFor(pool, toEvaluate.size(), [&](int k) {
+            int j = toEvaluate[k];
+            fitness[j] = calculateFitness(startState, startingUnitCounts, startingAddonCountPerUnitType, availableUnitTypes, generation[j]);
+        });
+
+        fitnessCache.insert(hashes, fitness, toEvaluate);
+    };
     for (int i = 0; i <= params.iterations; i++) {
         if (i == 150 && seed != nullptr) {
             // Add in the seed here
@@ -908,38 +1327,45 @@ std::pair<BuildOrder, BuildOrderFitness> findBestBuildOrderGeneticWithFitness(co
 
         vector<BuildOrderFitness> fitness(generation.size());
         vector<int> indices;
-        vector<BuildOrderGene> nextGeneration;
+        nextGenerationSize = 0;
         
         if (params.varianceBias <= 0) {
             indices = vector<int>(generation.size());
-            for (size_t j = 0; j < generation.size(); j++) {
-                indices[j] = j;
-                fitness[j] = calculateFitness(startState, startingUnitCounts, startingAddonCountPerUnitType, availableUnitTypes, generation[j]);
-            }
+            for (size_t j = 0; j < generation.size(); j++) indices[j] = j;
+            evaluateGeneration(fitness);
+
+            // Rank all genes using a scalar key first, only the best ones need the exact comparison.
+            // The exact comparison is not transitive so it can only be used with a bubble sort, which is too slow for large gene pools.
+            vector<float> rankingKeys(generation.size());
+            for (size_t j = 0; j < generation.size(); j++) rankingKeys[j] = fitness[j].rankingKey();
+            int eliteCount = min(5, params.genePoolSize);
+            auto window = indices.begin() + min((int)indices.size(), 2 * eliteCount);
+            partial_sort(indices.begin(), window, indices.end(), [&](int a, int b) { return rankingKeys[a] < rankingKeys[b] || (rankingKeys[a] == rankingKeys[b] && a < b); });
+            vector<int> best(indices.begin(), window);
+            sortByValueDescendingBubble<int, BuildOrderFitness>(best, [&](int index) { return fitness[index]; });
+            copy(best.begin(), best.end(), indices.begin());
 
-            sortByValueDescending<int, float>(indices, [=](int index) { return -fitness[index].time; });
-            sortByValueDescendingBubble<int, BuildOrderFitness>(indices, [=](int index) { return fitness[index]; });
             // Add the N best performing genes
-            for (int j = 0; j < min(5, params.genePoolSize); j++) {
-                nextGeneration.push_back(generation[indices[j]]);
+            for (int j = 0; j < eliteCount; j++) {
+                addToNextGeneration(generation[indices[j]]);
             }
             // Add a random one as well
-            nextGeneration.push_back(generation[uniform_int_distribution<int>(0, indices.size() - 1)(rnd)]);
+            addToNextGeneration(generation[uniform_int_distribution<int>(0, indices.size() - 1)(rnd)]);
         } else {
-            for (size_t j = 0; j < generation.size(); j++) {
-                fitness[j] = calculateFitness(startState, startingUnitCounts, startingAddonCountPerUnitType, availableUnitTypes, generation[j]);
-            }
+            evaluateGeneration(fitness);
+
+            // The distance from every gene to the closest selected gene is kept up to date incrementally,
+            // so each gene only has to be compared to the gene that was selected last
+            vector<float> scores(generation.size());
+            vector<float> minDistances(generation.size(), 1.0f);
+            for (size_t k = 0; k < generation.size(); k++) scores[k] = fitness[k].score();
 
             // Add the N best performing genes
             for (int j = 0; j < min(5, params.genePoolSize); j++) {
                 float bestScore = -100000000;
                 int bestIndex = -1;
                 for (size_t k = 0; k < generation.size(); k++) {
-                    float score = fitness[k].score();
-                    float minDistance = 1;
-                    for (auto& g : nextGeneration) minDistance = min(minDistance, geneDistance(generation[k], g));
-
-                    score -= fitness[k].time * (1 - minDistance) * params.varianceBias;
+                    float score = scores[k] - fitness[k].time * (1 - minDistances[k]) * params.varianceBias;
 
                     if (score > bestScore) {
                         bestScore = score;
@@ -949,20 +1375,26 @@ std::pair<BuildOrder, BuildOrderFitness> findBestBuildOrderGeneticWithFitness(co
 
                 assert(bestIndex != -1);
                 indices.push_back(bestIndex);
-                nextGeneration.push_back(generation[bestIndex]);
+                addToNextGeneration(generation[bestIndex]);
+                for (size_t k = 0; k < generation.size(); k++) {
+                    minDistances[k] = min(minDistances[k], geneDistance(generation[k], generation[bestIndex]));
+                }
             }
         }
 
         if ((i % 50) == 0 && i != 0) {
-            for (auto& g : nextGeneration) {
+            parallelFor(pool, nextGenerationSize, [&](int j) {
+                auto& g = nextGeneration[j];
                 g.validate(actionRequirements);
+                // The genes are already optimized in parallel, so each one runs on a single thread
                 g = locallyOptimizeGene(startState, startingUnitCounts, startingAddonCountPerUnitType, availableUnitTypes, actionRequirements, g);
                 g.validate(actionRequirements);
-            }
+            });
 
             // Expand build orders
             if (i > 150) {
-                for (auto& g : nextGeneration) {
+                for (int j = 0; j < nextGenerationSize; j++) {
+                    auto& g = nextGeneration[j];
                     // float f1 = calculateFitness(startState, uniqueStartingUnits, availableUnitTypes, g);
                     auto order = g.constructBuildOrder(startState.race, startState.foodAvailableInFuture(), startingUnitCounts, startingAddonCountPerUnitType, availableUnitTypes);
                     // cout << "Order size " << order.size() << endl;
@@ -977,10 +1409,11 @@ std::pair<BuildOrder, BuildOrderFitness> findBestBuildOrderGeneticWithFitness(co
             }
         }
 
-        uniform_int_distribution<int> randomParentIndex(0, nextGeneration.size() - 1);
-        while ((int)nextGeneration.size() < params.genePoolSize) {
-            nextGeneration.push_back(generation[randomParentIndex(rnd)]);
+        uniform_int_distribution<int> randomParentIndex(0, nextGenerationSize - 1);
+        while (nextGenerationSize < params.genePoolSize) {
+            addToNextGeneration(generation[randomParentIndex(rnd)]);
         }
+        nextGeneration.resize(nextGenerationSize);
 
         // Note: do not mutate the first gene
         for (size_t i = 1; i < nextGeneration.size(); i++) {
@@ -996,11 +1429,503 @@ std::pair<BuildOrder, BuildOrderFitness> findBestBuildOrderGeneticWithFitness(co
         lastBestFitness = fitness[indices[0]].score();
     }
     
-    generation[0] = locallyOptimizeGene(startState, startingUnitCounts, startingAddonCountPerUnitType, availableUnitTypes, actionRequirements, generation[0]);
+    generation[0] = locallyOptimizeGene(startState, startingUnitCounts, startingAddonCountPerUnitType, availableUnitTypes, actionRequirements, generation[0], pool);
 
     auto fitness = calculateFitness(startState, startingUnitCounts, startingAddonCountPerUnitType, availableUnitTypes, generation[0]);
+    auto best = make_pair(generation[0], fitness);
+    state.population = move(generation);
+    return best;
+}
+
+BuildOrder locallyOptimizeBuildOrder(const BuildState& startState, const BuildOrder& buildOrder, const vector<pair<BuildOrderItem, int>>& target, int threads) {
+    const BuildOptimizerProblem problem = prepareBuildOptimizerProblem(startState, target);
+    BuildOrderGene gene(buildOrder, problem.availableUnitTypes, problem.actionRequirements);
+    unique_ptr<ThreadPool> pool;
+    if (threads != 1) pool = make_unique<ThreadPool>(threads);
+    gene = locallyOptimizeGene(startState, problem.startingUnitCounts, problem.startingAddonCountPerUnitType, problem.availableUnitTypes, problem.actionRequirements, gene, pool.get());
+    return gene.constructBuildOrder(startState.race, startState.foodAvailableInFuture(), problem.startingUnitCounts, problem.startingAddonCountPerUnitType, problem.availableUnitTypes);
+}
+
+/** Minimum cost and build time of an item, used for the lower bounds in the beam search */
+struct BeamSearchItemCost {
+    float minerals = 0;
+    float vespene = 0;
+    float buildTime = 0;
+};
+
+static BeamSearchItemCost minimumItemCost(BuildOrderItem item, Race race) {
+    BeamSearchItemCost cost;
+    if (item.isUnitType()) {
+        auto unitType = item.typeID();
+        auto& unitData = getUnitData(unitType);
+        cost.minerals = unitData.mineral_cost;
+        cost.vespene = unitData.vespene_cost;
+        // Same as in BuildState::simulateBuildOrder, morphing only costs the difference
+        UNIT_TYPEID previous = upgradedFrom(unitType);
+        if (previous != UNIT_TYPEID::INVALID && !isAddon(unitType)) {
+            cost.minerals -= getUnitData(previous).mineral_cost;
+            cost.vespene -= getUnitData(previous).vespene_cost;
+        }
+        cost.buildTime = ticksToSeconds(unitData.build_time);
+    } else {
+        auto& upgradeData = getUpgradeData(item.upgradeID());
+        cost.minerals = upgradeData.mineral_cost;
+        cost.vespene = upgradeData.vespene_cost;
+        cost.buildTime = ticksToSeconds(upgradeData.research_time);
+    }
+
+    // Chrono boost can make things up to about a third faster, but structures are never chrono boosted
+    if (race == Race::Protoss && !(item.isUnitType() && isStructure(item.typeID()))) cost.buildTime *= 0.66f;
+    return cost;
+}
+
+/** A partial build order in the beam search together with the state right after its last item was started */
+struct BeamSearchNode {
+    /** Items that have been chosen so far (without implicit steps) */
+    vector<GeneUnitType> gene;
+    ImplicitStepsExpander expander;
+    BuildState state;
+    vector<int> remainingRequirements;
+    int remainingItems = 0;
+    int economicItems = 0;
+    /** Lower bound on the time when all target items started so far are finished */
+    float targetsFinishedTime = 0;
+    /** Lower bound on the time when all target items can be finished when continuing from this node */
+    float lowerBound = 0;
+    /** Estimate of the time when all target items will be finished, used to pick which nodes to keep */
+    float estimate = 0;
+
+    BeamSearchNode(const ImplicitStepsExpander& expander, const BuildState& state) : expander(expander), state(state) {}
+
+    /** Key for the transposition table.
+     * Nodes with the same key only differ in the time at which they reached the state, so the later one can be pruned.
+     */
+    uint64_t transpositionKey() const {
+        uint64_t key = state.zobristHashWithoutTime();
+        for (size_t i = 0; i < remainingRequirements.size(); i++) {
+            if (remainingRequirements[i] != 0) key += zobristKey(i, (uint64_t)remainingRequirements[i]);
+        }
+        return key + zobristKey(remainingRequirements.size(), (uint64_t)economicItems);
+    }
+};
+
+static float techChainFinishTime(int index, const AvailableUnitTypes& availableUnitTypes, const vector<int>& unitCounts, const vector<BeamSearchItemCost>& costs, vector<float>& startTimes);
+
+/** Earliest time, relative to now, at which the item can be started if none of its missing dependencies have been started yet.
+ * Only the requirements that BuildState::simulateBuildOrder waits for are followed: tech requirements (including tech aliases), addons, casters and upgrade dependencies.
+ * All of those must be finished before the item can be started, so the longest chain of them is a lower bound.
+ * The pylon that protoss structures need is not included as the simulation does not wait for it to finish.
+ * The results are memoized in startTimes, which must be initialized to a negative value.
+ */
+static float techChainStartTime(int index, const AvailableUnitTypes& availableUnitTypes, const vector<int>& unitCounts, const vector<BeamSearchItemCost>& costs, vector<float>& startTimes) {
+    if (startTimes[index] >= 0) return startTimes[index];
+    // Breaks cycles like probe -> nexus -> probe, any value is a valid lower bound for those
+    startTimes[index] = 0;
+
+    // Fastest way to get any of the types
+    auto anyOf = [&](const vector<UNIT_TYPEID>& types) {
+        float best = numeric_limits<float>::infinity();
+        for (auto type : types) {
+            if (type == UNIT_TYPEID::ZERG_LARVA) return 0.0f;
+            int j = availableUnitTypes.getIndexMaybe(type);
+            if (j != -1) best = min(best, techChainFinishTime(j, availableUnitTypes, unitCounts, costs, startTimes));
+        }
+        // Types that are not available are ignored
+        return isinf(best) ? 0.0f : best;
+    };
+
+    float result = 0;
+    auto item = availableUnitTypes.getBuildOrderItem(index);
+    if (item.isUnitType()) {
+        auto& unitData = getUnitData(item.typeID());
+        auto& casters = abilityToCasterUnit(unitData.ability_id);
+        if (unitData.tech_requirement != UNIT_TYPEID::INVALID) {
+            if (unitData.require_attached) {
+                if (casters.size() > 0) result = max(result, anyOf({ getSpecificAddonType(casters[0], unitData.tech_requirement) }));
+            } else {
+                // Same as BuildState::hasEquivalentTech
+                vector<UNIT_TYPEID> equivalent = { unitData.tech_requirement };
+                for (auto t : availableUnitTypes.getUnitTypes()) {
+                    for (auto t2 : getUnitData(t).tech_alias) {
+                        if (t2 == unitData.tech_requirement) equivalent.push_back(t);
+                    }
+                }
+                result = max(result, anyOf(equivalent));
+            }
+        }
+        result = max(result, anyOf(casters));
+    } else {
+        auto upgrade = item.upgradeID();
+        auto unitDependency = getUpgradeUnitDependency(upgrade);
+        if (unitDependency != UNIT_TYPEID::INVALID) result = max(result, anyOf({ unitDependency }));
+
+        auto upgradeDependency = getUpgradeUpgradeDependency(upgrade);
+        if (upgradeDependency != UPGRADE_ID::INVALID) {
+            int j = availableUnitTypes.getIndexMaybe(upgradeDependency);
+            if (j != -1) result = max(result, techChainFinishTime(j, availableUnitTypes, unitCounts, costs, startTimes));
+        }
+        result = max(result, anyOf(abilityToCasterUnit(getUpgradeData(upgrade).ability_id)));
+    }
+
+    startTimes[index] = result;
+    return result;
+}
+
+/** Earliest time, relative to now, at which the item can be finished. Zero if the item is already owned */
+static float techChainFinishTime(int index, const AvailableUnitTypes& availableUnitTypes, const vector<int>& unitCounts, const vector<BeamSearchItemCost>& costs, vector<float>& startTimes) {
+    if (unitCounts[index] > 0) return 0;
+    return techChainStartTime(index, availableUnitTypes, unitCounts, costs, startTimes) + costs[index].buildTime;
+}
+
+/** Calculates the lower bound and the estimate for the completion time of a node.
+ * The lower bound considers the tech chain (all missing dependencies must be built before the item, see #techChainStartTime) and the resources that are needed.
+ * For the lower bound the resources are assumed to be mined at the rate of fully saturated bases, the estimate uses the current mining rate instead.
+ */
+static void calculateBeamSearchBounds(BeamSearchNode& node, const AvailableUnitTypes& availableUnitTypes, const vector<BeamSearchItemCost>& costs) {
+    if (node.remainingItems == 0) {
+        node.lowerBound = node.estimate = node.targetsFinishedTime;
+        return;
+    }
+
+    int n = availableUnitTypes.size();
+    AvailableUnitMask remaining;
+    for (int i = 0; i < n && i < (int)remaining.size(); i++) remaining[i] = node.remainingRequirements[i] > 0;
+
+    float minerals = 0;
+    float vespene = 0;
+    float longestChain = 0;
+    float shortestItem = numeric_limits<float>::infinity();
+    AvailableUnitMask missing;
+    vector<float> startTimes(n, -1);
+    for (int i = 0; i < n; i++) {
+        if (node.remainingRequirements[i] <= 0) continue;
+
+        minerals += node.remainingRequirements[i] * costs[i].minerals;
+        vespene += node.remainingRequirements[i] * costs[i].vespene;
+        if (availableUnitTypes.hasTechTables(i)) {
+            // Dependencies which are target items themselves are already accounted for
+            missing |= availableUnitTypes.missingDependencies(i, node.expander.owned) & ~remaining;
+        }
+        float chain = techChainStartTime(i, availableUnitTypes, node.expander.unitCounts, costs, startTimes);
+        longestChain = max(longestChain, chain + costs[i].buildTime);
+        shortestItem = min(shortestItem, costs[i].buildTime);
+    }
+
+    for (int j = 0; j < n && j < (int)missing.size(); j++) {
+        if (missing[j]) {
+            minerals += costs[j].minerals;
+            vespene += costs[j].vespene;
+        }
+    }
+
+    auto maxSpeed = node.state.saturatedMiningSpeed();
+    auto currentSpeed = node.state.miningSpeed();
+    // Use the maximum speed for resources that are not being mined at all yet
+    if (currentSpeed.mineralsPerSecond <= 0) currentSpeed.mineralsPerSecond = maxSpeed.mineralsPerSecond;
+    if (currentSpeed.vespenePerSecond <= 0) currentSpeed.vespenePerSecond = maxSpeed.vespenePerSecond;
+
+    float time = node.state.time;
+    float techBound = time + longestChain;
+    node.lowerBound = max(node.targetsFinishedTime, max(techBound, time + node.state.timeToGetResources(maxSpeed, minerals, vespene) + shortestItem));
+    node.estimate = max(node.targetsFinishedTime, max(techBound, time + node.state.timeToGetResources(currentSpeed, minerals, vespene) + shortestItem));
+}
+
+static vector<BeamSearchItemCost> beamSearchItemCosts(const AvailableUnitTypes& availableUnitTypes, Race race) {
+    vector<BeamSearchItemCost> costs(availableUnitTypes.size());
+    for (size_t i = 0; i < costs.size(); i++) costs[i] = minimumItemCost(availableUnitTypes.getBuildOrderItem(i), race);
+    return costs;
+}
+
+static shared_ptr<BeamSearchNode> createBeamSearchRoot(const BuildOptimizerProblem& problem, const vector<BeamSearchItemCost>& costs) {
+    const BuildState& startState = problem.startState;
+    auto root = make_shared<BeamSearchNode>(ImplicitStepsExpander(startState.race, startState.foodAvailableInFuture(), problem.startingUnitCounts, problem.startingAddonCountPerUnitType, problem.availableUnitTypes), startState);
+    root->remainingRequirements = problem.actionRequirements;
+    for (int count : problem.actionRequirements) root->remainingItems += count;
+    root->targetsFinishedTime = startState.time;
+    calculateBeamSearchBounds(*root, problem.availableUnitTypes, costs);
+    return root;
+}
+
+float buildOrderLowerBound(const BuildState& startState, const vector<pair<BuildOrderItem, int>>& target) {
+    const BuildOptimizerProblem problem = prepareBuildOptimizerProblem(startState, target);
+    return createBeamSearchRoot(problem, beamSearchItemCosts(problem.availableUnitTypes, startState.race))->lowerBound;
+}
+
+/** Finds a build order using a beam search over build states.
+ *
+ * In every step each node in the beam is expanded with every item that the target still requires and with the economic items.
+ * The children are ranked by their estimated completion time and the best #BuildOptimizerParams::beamWidth unique states are kept.
+ * A transposition table records the earliest time each state has been reached, states that have already been reached earlier
+ * (possibly by a different ordering of the same items) are pruned.
+ * Nodes whose lower bound is worse than the best complete build order found so far are pruned (branch and bound).
+ * Finally all complete build orders are ranked using the same fitness function as the genetic algorithm.
+ *
+ * The lower bound is admissible as long as no new bases are started, since it assumes all current bases are fully saturated.
+ * The result is deterministic regardless of the number of threads.
+ */
+static pair<BuildOrderGene, BuildOrderFitness> runBeamSearch(const BuildOptimizerProblem& problem, const BuildOrder* seed, const BuildOptimizerParams& params, ThreadPool* pool) {
+    const BuildState& startState = problem.startState;
+    const AvailableUnitTypes& availableUnitTypes = problem.availableUnitTypes;
+    int n = availableUnitTypes.size();
+
+    vector<BeamSearchItemCost> costs = beamSearchItemCosts(availableUnitTypes, startState.race);
+
+    vector<int> actions;
+    int totalRequired = 0;
+    for (int i = 0; i < n; i++) {
+        if (problem.actionRequirements[i] > 0) actions.push_back(i);
+        totalRequired += problem.actionRequirements[i];
+    }
+    for (int i : problem.economicUnits) {
+        if (!contains(actions, i)) actions.push_back(i);
+    }
+    // Limits the depth of the search
+    int maxEconomicItems = max(8, totalRequired);
+
+    auto root = createBeamSearchRoot(problem, costs);
+
+    // The table is only written to between the expansion steps, which keeps the search deterministic
+    TranspositionTable reached(max((size_t)1 << 12, (size_t)params.beamWidth * actions.size() * maxEconomicItems * 4));
+    reached.improveBestTime(root->transpositionKey(), root->state.time);
+
+    vector<shared_ptr<BeamSearchNode>> beam = { root };
+    vector<pair<float, shared_ptr<BeamSearchNode>>> goals;
+    float bestGoalTime = numeric_limits<float>::infinity();
+    if (root->remainingItems == 0) {
+        goals.emplace_back(startState.time, root);
+        beam.clear();
+    }
+
+    while (!beam.empty()) {
+        vector<vector<shared_ptr<BeamSearchNode>>> children(beam.size());
+        parallelFor(pool, beam.size(), [&](int k) {
+            const BeamSearchNode& parent = *beam[k];
+            for (int action : actions) {
+                bool isTarget = parent.remainingRequirements[action] > 0;
+                if (!isTarget && parent.economicItems >= maxEconomicItems) continue;
+
+                auto child = make_shared<BeamSearchNode>(parent);
+                BuildOrder newItems;
+                child->gene.push_back(GeneUnitType(action));
+                child->expander.addItem(GeneUnitType(action), newItems, nullptr);
+
+                BuildState& childState = child->state;
+                float startTime = childState.time;
+                if (!childState.simulateBuildOrder(newItems, [&](int) { startTime = childState.time; }, false)) continue;
+
+                if (isTarget) {
+                    child->remainingRequirements[action]--;
+                    child->remainingItems--;
+                    child->targetsFinishedTime = max(child->targetsFinishedTime, startTime + costs[action].buildTime);
+                } else {
+                    child->economicItems++;
+                }
+
+                if (reached.reachedBy(child->transpositionKey(), childState.time)) continue;
+
+                calculateBeamSearchBounds(*child, availableUnitTypes, costs);
+                children[k].push_back(child);
+            }
+        });
+
+        vector<shared_ptr<BeamSearchNode>> nextBeam;
+        for (auto& nodeChildren : children) {
+            for (auto& child : nodeChildren) {
+                if (child->lowerBound > bestGoalTime) continue;
+
+                if (child->remainingItems == 0) {
+                    // All items have been started, the build order is complete when all events have finished
+                    float goalTime = child->state.events.empty() ? child->state.time : child->state.events.back().time;
+                    bestGoalTime = min(bestGoalTime, goalTime);
+                    goals.emplace_back(goalTime, child);
+                } else {
+                    nextBeam.push_back(child);
+                }
+            }
+        }
+
+        stable_sort(nextBeam.begin(), nextBeam.end(), [](const shared_ptr<BeamSearchNode>& a, const shared_ptr<BeamSearchNode>& b) { return a->estimate < b->estimate; });
+
+        // Keep the best unique states
+        beam.clear();
+        for (auto& node : nextBeam) {
+            if ((int)beam.size() >= params.beamWidth) break;
+            if (node->lowerBound > bestGoalTime) continue;
+
+            if (reached.improveBestTime(node->transpositionKey(), node->state.time)) beam.push_back(node);
+        }
+    }
+
+    // Rank the best complete build orders using the real fitness function
+    stable_sort(goals.begin(), goals.end(), [](const pair<float, shared_ptr<BeamSearchNode>>& a, const pair<float, shared_ptr<BeamSearchNode>>& b) { return a.first < b.first; });
+    if ((int)goals.size() > params.beamWidth) goals.resize(params.beamWidth);
+
+    vector<BuildOrderGene> candidates;
+    for (auto& goal : goals) {
+        BuildOrderGene gene;
+        gene.buildOrder = goal.second->gene;
+        candidates.push_back(gene);
+    }
+    if (seed != nullptr) candidates.push_back(BuildOrderGene(*seed, availableUnitTypes, problem.actionRequirements));
+    if (candidates.empty()) {
+        // Nothing found, fall back to just building the target items
+        vector<int> items;
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j < problem.actionRequirements[i]; j++) items.push_back(i);
+        }
+        candidates.push_back(BuildOrderGene(items));
+    }
+
+    vector<BuildOrderFitness> fitness(candidates.size());
+    parallelFor(pool, candidates.size(), [&](int i) {
+        fitness[i] = calculateFitness(startState, problem.startingUnitCounts, problem.startingAddonCountPerUnitType, availableUnitTypes, candidates[i]);
+    });
+
+    int bestIndex = 0;
+    for (int i = 1; i < (int)candidates.size(); i++) {
+        if (fitness[bestIndex] < fitness[i]) bestIndex = i;
+    }
+    return make_pair(candidates[bestIndex], fitness[bestIndex]);
+}
+
+/** Runs the optimizer selected in the parameters on a prepared problem.
+ * Random numbers are derived from the base seed only, so the result does not depend on the thread pool.
+ * If a fitness cache is given, the genetic optimizer uses it instead of a cache of its own.
+ */
+static pair<BuildOrder, BuildOrderFitness> solveBuildOptimizerProblem(const BuildOptimizerProblem& problem, const BuildOrder* seed, const BuildOptimizerParams& params, unsigned int baseSeed, ThreadPool* pool, FitnessCache* fitnessCache = nullptr) {
+    const BuildState& startState = problem.startState;
+
+    if (params.algorithm == BuildOptimizerAlgorithm::BeamSearch) {
+        auto best = runBeamSearch(problem, seed, params, pool);
+        return make_pair(best.first.constructBuildOrder(startState.race, startState.foodAvailableInFuture(), problem.startingUnitCounts, problem.startingAddonCountPerUnitType, problem.availableUnitTypes), best.second);
+    }
+
+    int restarts = max(1, params.restarts);
+
+    // Each restart gets its own random engine derived from the base seed, so that the result does not depend on how the restarts are scheduled
+    vector<pair<BuildOrderGene, BuildOrderFitness>> results(restarts);
+    auto runRestart = [&](int restart, ThreadPool* restartPool) {
+        seed_seq restartSeed { baseSeed, (unsigned int)restart };
+        default_random_engine rnd(restartSeed);
+        results[restart] = runGeneticOptimizer(problem, seed, params, rnd, restartPool, nullptr, fitnessCache);
+    };
+
+    if (restarts == 1) {
+        runRestart(0, pool);
+    } else {
+        // Run the restarts in parallel rather than the fitness evaluations inside them, that gives much larger work items
+        parallelFor(pool, restarts, [&](int restart) { runRestart(restart, nullptr); });
+    }
+
+    // Pick the best run. Ties go to the earliest run to keep the result deterministic.
+    int bestIndex = 0;
+    for (int i = 1; i < restarts; i++) {
+        if (results[bestIndex].second < results[i].second) bestIndex = i;
+    }
+
+    auto& best = results[bestIndex];
+    return make_pair(best.first.constructBuildOrder(startState.race, startState.foodAvailableInFuture(), problem.startingUnitCounts, problem.startingAddonCountPerUnitType, problem.availableUnitTypes), best.second);
+}
+
+std::pair<BuildOrder, BuildOrderFitness> findBestBuildOrderGeneticWithFitness(const BuildState& startState, const std::vector<std::pair<BuildOrderItem, int>>& target, const BuildOrder* seed, BuildOptimizerParams params) {
+    const BuildOptimizerProblem problem = prepareBuildOptimizerProblem(startState, target);
+
+    // Fitness evaluations are independent of each other and make up almost all of the running time, so they are spread out over a pool of threads.
+    // Note that all random numbers are drawn on a single thread, so the result is the same regardless of the number of threads.
+    unique_ptr<ThreadPool> pool;
+    if (params.threads != 1) pool = make_unique<ThreadPool>(params.threads);
+
+    unsigned int baseSeed = params.seed != 0 ? params.seed : random_device()();
+    return solveBuildOptimizerProblem(problem, seed, params, baseSeed, pool.get());
+}
+
+vector<pair<BuildOrder, BuildOrderFitness>> findBestBuildOrdersGenetic(const BuildState& startState, const vector<vector<pair<BuildOrderItem, int>>>& targets, BuildOptimizerParams params) {
+    // The start state is only simulated once, every target just gets its own action requirements
+    const BuildOptimizerProblem sharedProblem = prepareBuildOptimizerProblem(startState);
+    vector<BuildOptimizerProblem> problems(targets.size(), sharedProblem);
+    for (size_t i = 0; i < targets.size(); i++) setBuildOptimizerTarget(problems[i], targets[i]);
+
+    // The fitness of a gene does not depend on the target, so genes that are found for several targets (e.g. common openings) are only simulated once
+    FitnessCache fitnessCache;
+
+    unique_ptr<ThreadPool> pool;
+    if (params.threads != 1) pool = make_unique<ThreadPool>(params.threads);
+
+    unsigned int baseSeed = params.seed != 0 ? params.seed : random_device()();
+
+    // Run the optimizations in parallel rather than the fitness evaluations inside them, that gives much larger work items.
+    // Each target gets its own seed derived from the base seed, so the result does not depend on the number of threads.
+    vector<pair<BuildOrder, BuildOrderFitness>> results(targets.size());
+    parallelFor(pool.get(), targets.size(), [&](int i) {
+        seed_seq targetSeedSequence { baseSeed, (unsigned int)i, 1u };
+        unsigned int targetSeed;
+        targetSeedSequence.generate(&targetSeed, &targetSeed + 1);
+        results[i] = solveBuildOptimizerProblem(problems[i], nullptr, params, targetSeed, nullptr, &fitnessCache);
+    });
+    return results;
+}
+
+struct BuildOrderReplanner::State {
+    GeneticOptimizerState optimizer;
+    default_random_engine rnd;
+    unique_ptr<ThreadPool> pool;
+
+    /** Inputs of the previous run, used to find out how far the start state has moved forward */
+    Race race = Race::Random;
+    vector<int> startingUnitCounts;
+    uint64_t startStateHash = 0;
+
+    BuildOrder replan(const BuildOrderReplanner& replanner, const BuildOptimizerProblem& problem, const BuildOrder* currentBuildOrder) {
+        const BuildState& startState = problem.startState;
+        const BuildOptimizerParams& params = replanner.params;
+        if (params.threads != 1 && pool == nullptr) pool = make_unique<ThreadPool>(params.threads);
+
+        bool warmStart = !optimizer.population.empty() && race == startState.race && startingUnitCounts.size() == problem.startingUnitCounts.size();
+
+        // The cached fitness values are only valid for the start state they were calculated for.
+        // Genes are simulated from the start state, so there is no part of the fitness that would survive the state moving forward.
+        uint64_t stateHash = startState.hash();
+        if (!warmStart || stateHash != startStateHash) optimizer.fitnessCache.clear();
+
+        BuildOptimizerParams runParams = params;
+        const BuildOrder* seed = currentBuildOrder;
+        if (warmStart) {
+            // Everything that has been built since the last run is already part of the start state
+            vector<int> completedCounts(startingUnitCounts.size());
+            for (size_t i = 0; i < completedCounts.size(); i++) completedCounts[i] = max(0, problem.startingUnitCounts[i] - startingUnitCounts[i]);
+            for (auto& gene : optimizer.population) gene.dropCompletedItems(completedCounts, problem.actionRequirements);
+
+            // The optimizer only adds the seed after 150 iterations, so put the current build order into the population directly
+            if (currentBuildOrder != nullptr) optimizer.population.back() = BuildOrderGene(*currentBuildOrder, problem.availableUnitTypes, problem.actionRequirements);
+            seed = nullptr;
+            runParams.iterations = replanner.warmStartIterations;
+        } else {
+            optimizer.population.clear();
+        }
+
+        auto best = runGeneticOptimizer(problem, seed, runParams, rnd, pool.get(), &optimizer);
 
-    return make_pair(generation[0].constructBuildOrder(startState.race, startState.foodAvailableInFuture(), startingUnitCounts, startingAddonCountPerUnitType, availableUnitTypes), fitness);
+        race = startState.race;
+        startingUnitCounts = problem.startingUnitCounts;
+        startStateHash = stateHash;
+        return best.first.constructBuildOrder(startState.race, startState.foodAvailableInFuture(), problem.startingUnitCounts, problem.startingAddonCountPerUnitType, problem.availableUnitTypes);
+    }
+};
+
+BuildOrderReplanner::BuildOrderReplanner(BuildOptimizerParams params) : params(params), state(make_unique<State>()) {
+    state->rnd.seed(params.seed != 0 ? params.seed : random_device()());
+}
+
+BuildOrderReplanner::~BuildOrderReplanner() {}
+
+BuildOrder BuildOrderReplanner::replan(const BuildState& startState, const vector<pair<BuildOrderItem, int>>& target, const BuildOrder* currentBuildOrder) {
+    const BuildOptimizerProblem problem = prepareBuildOptimizerProblem(startState, target);
+    return state->replan(*this, problem, currentBuildOrder);
+}
+
+void BuildOrderReplanner::reset() {
+    state->optimizer.population.clear();
+    state->optimizer.fitnessCache.clear();
 }
 
 vector<UNIT_TYPEID> buildOrderProBO = {
@@ -1796,14 +2721,17 @@ void unitTestBuildOptimizer() {
     // logBuildOrder(optimizer.calculate_build_order(Race::Terran, { { UNIT_TYPEID::TERRAN_COMMANDCENTER, 1 }, { UNIT_TYPEID::TERRAN_SCV, 12 } }, { { UNIT_TYPEID::TERRAN_MARINE, 5 } }));
 }
 
+float BuildOrderFitness::rankingKey() const {
+    // Leftover resources make up for some of the time, depending on how long it would take to mine them
+    const float weight = 0.5f;
+    return time - weight * 0.5f * ((resources.minerals / (1 + miningSpeed.mineralsPerSecond)) + (resources.vespene / (1 + miningSpeed.vespenePerSecond)));
+}
+
 bool BuildOrderFitness::operator<(const BuildOrderFitness& other) const {
     if(false) return score() < other.score();
     
-    float t = time;
-    float otherTime = other.time;
-    const float weight = 0.5f;
-    t -= weight * 0.5f * ((resources.minerals / (1 + miningSpeed.mineralsPerSecond)) + (resources.vespene / (1 + miningSpeed.vespenePerSecond)));
-    otherTime -= weight * 0.5f * ((other.resources.minerals / (1 + other.miningSpeed.mineralsPerSecond)) + (other.resources.vespene / (1 + other.miningSpeed.vespenePerSecond)));
+    float t = rankingKey();
+    float otherTime = other.rankingKey();
 
     if (otherTime < t) return !(other < *this);
 
@@ -1834,30 +2762,14 @@ bool BuildOrderFitness::operator<(const BuildOrderFitness& other) const {
 }
 
 void optimizeExistingBuildOrder(const ObservationInterface* observation, const std::vector<const sc2::Unit*>& ourUnits, const BuildState& startState, BuildOrderTracker& buildOrder, bool serialize) {
-    const AvailableUnitTypes& availableUnitTypes = getAvailableUnitsForRace(startState.race, UnitCategory::BuildOrderOptions);
-    const AvailableUnitTypes& allEconomicUnits = getAvailableUnitsForRace(startState.race, UnitCategory::Economic);
-
     auto doneItems = buildOrder.update(observation, ourUnits);
 
-    // Simulate the starting state until all current events have finished, only then do we know which exact unit types the player will start with.
-    // This is important for implicit dependencies in the build order.
-    // If say a factory is under construction, we don't want to implictly build another factory if the build order specifies that a tank is supposed to be built.
-    BuildState startStateAfterEvents = startState;
-    startStateAfterEvents.simulate(startStateAfterEvents.time + 1000000);
-
-    vector<int> startingUnitCounts;
-    vector<int> startingAddonCountPerUnitType;
-    tie(startingUnitCounts, startingAddonCountPerUnitType) = calculateStartingUnitCounts(startStateAfterEvents, availableUnitTypes);
-
-    vector<int> economicUnits;
-    for (size_t i = 0; i < allEconomicUnits.size(); i++) {
-        // Do not allow more than 8 bases (all the workers start to eat up the supply cap)
-        if (isTownHall(availableUnitTypes.getUnitType(i)) && startingUnitCounts[availableUnitTypes.getIndex(getTownHallForRace(startState.race))] >= 8) continue;
-        // Do not allow more than 100 workers
-        if (isBasicHarvester(availableUnitTypes.getUnitType(i)) && startingUnitCounts[availableUnitTypes.getIndex(getHarvesterUnitForRace(startState.race))] >= 100) continue;
-
-        economicUnits.push_back(remapAvailableUnitIndex(i, allEconomicUnits, availableUnitTypes));
-    }
+    const BuildOptimizerProblem problem = prepareBuildOptimizerProblem(startState, true);
+    const AvailableUnitTypes& availableUnitTypes = problem.availableUnitTypes;
+    const BuildState& startStateAfterEvents = problem.startStateAfterEvents;
+    const vector<int>& startingUnitCounts = problem.startingUnitCounts;
+    const vector<int>& startingAddonCountPerUnitType = problem.startingAddonCountPerUnitType;
+    const vector<int>& economicUnits = problem.economicUnits;
 
     vector<int> actionRequirements(availableUnitTypes.size());
     BuildOrderGene gene;
@@ -1871,7 +2783,7 @@ void optimizeExistingBuildOrder(const ObservationInterface* observation, const s
                 // Not a goal item
             } else {
                 // Important stuff
-                actionRequirements[availableUnitTypes.getGeneItem(item).type]++;
+                actionRequirements[availableUnitTypes.getGeneItem(item).type()]++;
             }
         }
     }
@@ -1932,3 +2844,27 @@ void optimizeExistingBuildOrder(const ObservationInterface* observation, const s
     }
     buildOrder.tweakBuildOrder(doneItems, newBuildOrder);
 }
+
+void optimizeExistingBuildOrder(const ObservationInterface* observation, const std::vector<const sc2::Unit*>& ourUnits, const BuildState& startState, BuildOrderTracker& buildOrder, BuildOrderReplanner& replanner) {
+    auto doneItems = buildOrder.update(observation, ourUnits);
+
+    BuildOptimizerProblem problem = prepareBuildOptimizerProblem(startState, true);
+    const AvailableUnitTypes& availableUnitTypes = problem.availableUnitTypes;
+
+    // The remaining non-economic items are the goal, the remaining structures and workers are only used as a seed
+    problem.actionRequirements = vector<int>(availableUnitTypes.size());
+    BuildOrder remainingBuildOrder;
+    for (size_t i = 0; i < buildOrder.buildOrder.size(); i++) {
+        if (!doneItems[i]) {
+            auto item = buildOrder.buildOrder[i];
+            remainingBuildOrder.items.push_back(item);
+
+            if (!item.isUnitType() || !(isStructure(item.typeID()) || isBasicHarvester(item.typeID()))) {
+                problem.actionRequirements[availableUnitTypes.getGeneItem(item).type()]++;
+            }
+        }
+    }
+
+    auto newBuildOrder = replanner.state->replan(replanner, problem, &remainingBuildOrder);
+    buildOrder.tweakBuildOrder(doneItems, newBuildOrder);
+}
@@ -1,26 +1,49 @@
 #pragma once
 #include <vector>
+#include <cassert>
 #include <cmath>
+#include <cstdint>
 #include <functional>
+#include <memory>
 #include "sc2api/sc2_interfaces.h"
 #include <libvoxelbot/combat/simulator.h>
 #include <libvoxelbot/buildorder/build_order.h>
 #include <libvoxelbot/buildorder/build_state.h>
 
+struct AvailableUnitTypes;
+
+/** An item in a build order gene, packed into 16 bits.
+ * The lowest bit is the chrono boost flag and the remaining bits are the index of the item in the AvailableUnitTypes list.
+ * A gene is a flat array of these, so comparing and hashing genes are simple passes over memory.
+ */
 struct GeneUnitType {
-    int type = -1;
-    bool chronoBoosted = false;
+    uint16_t code = 0xFFFF;
 
     GeneUnitType() {}
-    GeneUnitType(int type) : type(type), chronoBoosted(false) {}
-    GeneUnitType(int type, bool chronoBoosted) : type(type), chronoBoosted(chronoBoosted) {}
+    GeneUnitType(int type) : GeneUnitType(type, false) {}
+    GeneUnitType(int type, bool chronoBoosted) : code((uint16_t)((type << 1) | (int)chronoBoosted)) {
+        assert(type >= 0 && type < (1 << 15));
+    }
+
+    /** Index of the item in the AvailableUnitTypes list */
+    int type() const {
+        return code >> 1;
+    }
+
+    bool chronoBoosted() const {
+        return (code & 1) != 0;
+    }
+
+    void setChronoBoosted(bool chronoBoosted) {
+        code = (uint16_t)((code & ~1) | (int)chronoBoosted);
+    }
 
     bool operator==(const GeneUnitType& other) const {
-        return type == other.type && chronoBoosted == other.chronoBoosted;
+        return code == other.code;
     }
 
     bool operator!=(const GeneUnitType& other) const {
-        return type != other.type || chronoBoosted != other.chronoBoosted;
+        return code != other.code;
     }
 };
 
@@ -37,25 +60,114 @@ struct BuildOrderFitness {
 
     float score() const;
 
+    /** Scalar approximation of #operator<, lower is better.
+     * Cheap to sort by, unlike the exact comparison which is not transitive.
+     */
+    float rankingKey() const;
+
     bool operator<(const BuildOrderFitness& other) const;
 };
 
+enum class BuildOptimizerAlgorithm {
+    /** Evolutionary algorithm over build orders. Randomized, controlled by #BuildOptimizerParams::iterations */
+    Genetic,
+    /** Beam search over build states with branch and bound pruning. Deterministic, controlled by #BuildOptimizerParams::beamWidth */
+    BeamSearch,
+};
+
 struct BuildOptimizerParams {
+    /** Search algorithm that is used to find the build order */
+    BuildOptimizerAlgorithm algorithm = BuildOptimizerAlgorithm::Genetic;
+    /** Number of partial build orders that the beam search keeps in every step */
+    int beamWidth = 32;
     int genePoolSize = 25;
     int iterations = 512;
     float mutationRateAddRemove = 0.05f;
     float mutationRateMove = 0.025f;
     float varianceBias = 0;
     bool allowChronoBoost = true;
+    /** Number of threads used to evaluate the fitness of the genes. 1 runs everything on the calling thread, 0 uses all hardware threads.
+     * The result does not depend on the number of threads as all random numbers are drawn on the calling thread.
+     */
+    int threads = 1;
+    /** Seed for the random number generator. The same seed and parameters will always result in the same build order.
+     * If zero, a random seed will be used.
+     */
+    unsigned int seed = 0;
+    /** Number of independent runs of the optimizer, each with a different seed derived from #seed. The best resulting build order is returned.
+     * The runs will be distributed over the threads.
+     * Only used by the genetic algorithm.
+     */
+    int restarts = 1;
 };
 
 std::pair<BuildOrder, std::vector<bool>> expandBuildOrderWithImplicitSteps (const BuildState& startState, BuildOrder buildOrder);
 
+/** Tech buildings, addons and casters that have to be built before the item, in the order they need to be built in.
+ * This walks the tech tree, which is what the implicit step expansion does when the precomputed tech tables (see AvailableUnitTypes::initTechTables) cannot be used.
+ * The unit counts are indexed like the available unit types.
+ */
+std::vector<BuildOrderItem> traceMissingDependencies(const std::vector<int>& unitCounts, const AvailableUnitTypes& availableUnitTypes, BuildOrderItem item);
+
+/** Lower bound on the time at which all target items can be finished when starting from the given state.
+ * This is the bound that the beam search uses for pruning, it includes the tech chain and the time to mine the resources.
+ */
+float buildOrderLowerBound(const BuildState& startState, const std::vector<std::pair<BuildOrderItem, int>>& target);
+
 BuildOrder findBestBuildOrderGenetic(const std::vector<std::pair<sc2::UNIT_TYPEID, int>>& startingUnits, const std::vector<std::pair<sc2::UNIT_TYPEID, int>>& target);
 BuildOrder findBestBuildOrderGenetic(const BuildState& startState, const std::vector<std::pair<sc2::UNIT_TYPEID, int>>& target, const BuildOrder* seed = nullptr, BuildOptimizerParams params = BuildOptimizerParams());
 std::pair<BuildOrder, BuildOrderFitness> findBestBuildOrderGeneticWithFitness(const BuildState& startState, const std::vector<std::pair<BuildOrderItem, int>>& target, const BuildOrder* seed = nullptr, BuildOptimizerParams params = BuildOptimizerParams());
 BuildOrder findBestBuildOrderGenetic(const BuildState& startState, const std::vector<std::pair<BuildOrderItem, int>>& target, const BuildOrder* seed = nullptr, BuildOptimizerParams params = BuildOptimizerParams());
+
+/** Finds the best build order for each of the targets, all starting from the same state.
+ * The start state is only preprocessed once, and the optimizations for the different targets run in parallel using #BuildOptimizerParams::threads threads.
+ * The fitness of a build order does not depend on the target, so the genetic optimizer runs for all targets share a single fitness cache.
+ * Returns the build orders and their fitness in the same order as the targets.
+ */
+std::vector<std::pair<BuildOrder, BuildOrderFitness>> findBestBuildOrdersGenetic(const BuildState& startState, const std::vector<std::vector<std::pair<BuildOrderItem, int>>>& targets, BuildOptimizerParams params = BuildOptimizerParams());
 void unitTestBuildOptimizer();
 void printBuildOrderDetailed(const BuildState& startState, const BuildOrder& buildOrder, const std::vector<bool>* highlight = nullptr);
 void optimizeExistingBuildOrder(const sc2::ObservationInterface* observation, const std::vector<const sc2::Unit*>& ourUnits, const BuildState& buildOrderStartingState, BuildOrderTracker& buildOrder, bool serialize);
-BuildOrderFitness calculateFitness(const BuildState& startState, const BuildOrder& buildOrder);
\ No newline at end of file
+
+/** Replans a build order repeatedly during a game, warm starting the genetic algorithm from the previous plan.
+ *
+ * The population is kept between calls.
+ * Fitness values depend on the start state, so the cache of them is only reused if the next call has exactly the same start state
+ * (e.g. when only the target has changed). During a game the start state usually moves forward between calls, which clears the cache.
+ * When the start state has moved forward the items that have been completed since the last call are removed from every gene in the population,
+ * which makes the optimizer converge in a fraction of the iterations that are needed when starting from scratch.
+ */
+struct BuildOrderReplanner {
+    /** Parameters for the optimizer. The first call runs #BuildOptimizerParams::iterations iterations, restarts are not supported. */
+    BuildOptimizerParams params;
+    /** Number of iterations that are used when warm starting from the previous population */
+    int warmStartIterations = 64;
+
+    explicit BuildOrderReplanner(BuildOptimizerParams params = BuildOptimizerParams());
+    ~BuildOrderReplanner();
+
+    /** Finds a build order for the given target, starting from the previous population if there is one.
+     * The current build order (if any) is added to the population as well.
+     */
+    BuildOrder replan(const BuildState& startState, const std::vector<std::pair<BuildOrderItem, int>>& target, const BuildOrder* currentBuildOrder = nullptr);
+
+    /** Forgets the previous population, the next call will start from scratch */
+    void reset();
+
+private:
+    struct State;
+    std::unique_ptr<State> state;
+
+    friend void optimizeExistingBuildOrder(const sc2::ObservationInterface* observation, const std::vector<const sc2::Unit*>& ourUnits, const BuildState& buildOrderStartingState, BuildOrderTracker& buildOrder, BuildOrderReplanner& replanner);
+};
+
+/** Same as the other overload but uses a full run of the optimizer for the remaining items, warm started from the replanner's previous population.
+ * Cheap enough to be called every few seconds.
+ */
+void optimizeExistingBuildOrder(const sc2::ObservationInterface* observation, const std::vector<const sc2::Unit*>& ourUnits, const BuildState& buildOrderStartingState, BuildOrderTracker& buildOrder, BuildOrderReplanner& replanner);
+BuildOrderFitness calculateFitness(const BuildState& startState, const BuildOrder& buildOrder);
+
+/** Improves a build order by removing non-essential items and swapping adjacent items, as long as the build order still builds the target units.
+ * The candidate changes are evaluated on the given number of threads (same meaning as #BuildOptimizerParams::threads). The result does not depend on the number of threads.
+ */
+BuildOrder locallyOptimizeBuildOrder(const BuildState& startState, const BuildOrder& buildOrder, const std::vector<std::pair<BuildOrderItem, int>>& target, int threads = 1);
\ No newline at end of file
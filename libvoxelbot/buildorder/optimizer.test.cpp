@@ -1,6 +1,8 @@
 #include <libvoxelbot/buildorder/build_state.h>
+#include <libvoxelbot/buildorder/optimizer.h>
 #include <libvoxelbot/common/unit_lists.h>
 #include <libvoxelbot/buildorder/build_time_estimator.h>
+#include <libvoxelbot/utilities/mappings.h>
 
 using namespace std;
 using namespace sc2;
@@ -33,5 +35,195 @@ int main () {
     assert(numGateways == 1);
     assert(numPylons == 1);
     assert(numOthers == 0);
+
+    {
+        // The optimizer should be reproducible for a given seed, regardless of the number of threads
+        BuildOptimizerParams params;
+        params.iterations = 100;
+        params.seed = 1234;
+        vector<pair<BuildOrderItem, int>> target = {
+            { BuildOrderItem(UNIT_TYPEID::PROTOSS_STALKER), 2 },
+            { BuildOrderItem(UNIT_TYPEID::PROTOSS_ZEALOT), 2 },
+        };
+        auto result1 = findBestBuildOrderGeneticWithFitness(state, target, nullptr, params);
+        params.threads = 4;
+        auto result2 = findBestBuildOrderGeneticWithFitness(state, target, nullptr, params);
+        assert(result1.first.items == result2.first.items);
+        assert(result1.second.time == result2.second.time);
+
+        // Restarts run in parallel, but should be just as reproducible
+        params.restarts = 3;
+        auto result3 = findBestBuildOrderGeneticWithFitness(state, target, nullptr, params);
+        params.threads = 1;
+        auto result4 = findBestBuildOrderGeneticWithFitness(state, target, nullptr, params);
+        assert(result3.first.items == result4.first.items);
+        assert(result3.second.time < BuildOrderFitness::ReallyBad.time);
+
+        // Local optimization evaluates its candidate changes in parallel, but should give the same result as on a single thread
+        BuildOrder padded = result1.first;
+        padded.items.push_back(BuildOrderItem(UNIT_TYPEID::PROTOSS_PYLON));
+        auto local1 = locallyOptimizeBuildOrder(state, padded, target);
+        auto local4 = locallyOptimizeBuildOrder(state, padded, target, 4);
+        assert(local1.items == local4.items);
+    }
+
+    {
+        // The precomputed tech tables should agree with walking the tech tree
+        auto& types = getAvailableUnitsForRace(Race::Protoss);
+        int stalker = types.getIndex(UNIT_TYPEID::PROTOSS_STALKER);
+        int gateway = types.getIndex(UNIT_TYPEID::PROTOSS_GATEWAY);
+        int cyberneticsCore = types.getIndex(UNIT_TYPEID::PROTOSS_CYBERNETICSCORE);
+        int pylon = types.getIndex(UNIT_TYPEID::PROTOSS_PYLON);
+        int nexus = types.getIndex(UNIT_TYPEID::PROTOSS_NEXUS);
+        int probe = types.getIndex(UNIT_TYPEID::PROTOSS_PROBE);
+        assert(types.hasTechTables(stalker));
+
+        vector<int> unitCounts(types.size());
+        unitCounts[nexus] = 1;
+        unitCounts[probe] = 12;
+        auto missing = types.missingDependencies(stalker, types.ownedMask(unitCounts));
+        assert(missing[gateway] && missing[cyberneticsCore] && missing[pylon]);
+        assert(!missing[nexus] && !missing[probe] && !missing[stalker]);
+
+        // Check every item with the tables against the slow path, while adding the Stalker tech one building at a time
+        for (int owned : { -1, pylon, gateway, cyberneticsCore }) {
+            if (owned != -1) unitCounts[owned] = 1;
+            auto ownedMask = types.ownedMask(unitCounts);
+            for (size_t i = 0; i < types.size(); i++) {
+                if (!types.hasTechTables(i)) continue;
+
+                auto traced = traceMissingDependencies(unitCounts, types, types.getBuildOrderItem(i));
+                assert(types.dependenciesSatisfied(i, ownedMask) == traced.empty());
+                auto missingMask = types.missingDependencies(i, ownedMask);
+                for (auto item : traced) assert(missingMask[item.isUnitType() ? types.getIndex(item.typeID()) : types.getIndex(item.upgradeID())]);
+            }
+        }
+        assert(types.dependenciesSatisfied(stalker, types.ownedMask(unitCounts)));
+    }
+
+    {
+        // The beam search bound for a stalker must include the whole gateway -> cybernetics core -> stalker chain.
+        // The stalker itself may be chrono boosted, which makes it up to a third faster.
+        auto buildTime = [](UNIT_TYPEID type) { return ticksToSeconds(getUnitData(type).build_time); };
+        float chain = buildTime(UNIT_TYPEID::PROTOSS_GATEWAY) + buildTime(UNIT_TYPEID::PROTOSS_CYBERNETICSCORE) + buildTime(UNIT_TYPEID::PROTOSS_STALKER) * 0.66f;
+        float bound = buildOrderLowerBound(state, { { BuildOrderItem(UNIT_TYPEID::PROTOSS_STALKER), 1 } });
+        assert(bound >= state.time + chain);
+
+        // The bound must never be larger than the time of a build order that was actually found
+        BuildOptimizerParams params;
+        params.algorithm = BuildOptimizerAlgorithm::BeamSearch;
+        auto result = findBestBuildOrderGeneticWithFitness(state, { { BuildOrderItem(UNIT_TYPEID::PROTOSS_STALKER), 1 } }, nullptr, params);
+        assert(bound <= result.second.time);
+    }
+
+    {
+        // The beam search should find a valid build order, and it should be deterministic
+        BuildOptimizerParams params;
+        params.algorithm = BuildOptimizerAlgorithm::BeamSearch;
+        params.beamWidth = 8;
+        vector<pair<BuildOrderItem, int>> target = {
+            { BuildOrderItem(UNIT_TYPEID::PROTOSS_STALKER), 2 },
+            { BuildOrderItem(UNIT_TYPEID::PROTOSS_ZEALOT), 1 },
+        };
+        auto result1 = findBestBuildOrderGeneticWithFitness(state, target, nullptr, params);
+        params.threads = 4;
+        auto result2 = findBestBuildOrderGeneticWithFitness(state, target, nullptr, params);
+        assert(result1.second.time < BuildOrderFitness::ReallyBad.time);
+        assert(result1.first.items == result2.first.items);
+
+        int numStalkers = 0;
+        for (auto item : result1.first) {
+            if (item.typeID() == UNIT_TYPEID::PROTOSS_STALKER) numStalkers++;
+        }
+        assert(numStalkers == 2);
+    }
+
+    {
+        // Batches of targets share the start state and should be just as reproducible as single runs
+        BuildOptimizerParams params;
+        params.seed = 3;
+        params.iterations = 64;
+        vector<vector<pair<BuildOrderItem, int>>> targets = {
+            { { BuildOrderItem(UNIT_TYPEID::PROTOSS_ZEALOT), 2 } },
+            { { BuildOrderItem(UNIT_TYPEID::PROTOSS_STALKER), 1 } },
+        };
+        auto results1 = findBestBuildOrdersGenetic(state, targets, params);
+        params.threads = 4;
+        auto results2 = findBestBuildOrdersGenetic(state, targets, params);
+        assert(results1.size() == targets.size());
+        for (size_t i = 0; i < targets.size(); i++) {
+            assert(results1[i].first.items == results2[i].first.items);
+            assert(results1[i].second.time < BuildOrderFitness::ReallyBad.time);
+
+            int count = 0;
+            for (auto item : results1[i].first) {
+                if (item.typeID() == targets[i][0].first.typeID()) count++;
+            }
+            assert(count == targets[i][0].second);
+        }
+    }
+
+    {
+        // Replanning after part of the plan has been executed should still reach the target
+        BuildOptimizerParams params;
+        params.seed = 7;
+        params.iterations = 128;
+        BuildOrderReplanner replanner(params);
+        vector<pair<BuildOrderItem, int>> target = {
+            { BuildOrderItem(UNIT_TYPEID::PROTOSS_ZEALOT), 4 },
+        };
+        auto plan1 = replanner.replan(state, target);
+
+        BuildState laterState = state;
+        BuildOrder executed;
+        executed.items.assign(plan1.items.begin(), plan1.items.begin() + plan1.size() / 2);
+        bool success = laterState.simulateBuildOrder(executed, nullptr, false);
+        assert(success);
+
+        BuildOrder remaining;
+        remaining.items.assign(plan1.items.begin() + executed.size(), plan1.items.end());
+        auto plan2 = replanner.replan(laterState, target, &remaining);
+        BuildState finalState = laterState;
+        success = finalState.simulateBuildOrder(plan2);
+        assert(success);
+
+        int zealots = 0;
+        for (auto& u : finalState.units) if (u.type == UNIT_TYPEID::PROTOSS_ZEALOT) zealots += u.units;
+        assert(zealots >= 4);
+    }
+
+    for (auto race : { Race::Protoss, Race::Terran }) {
+        // The fast economy simulation should match building workers and supply one item at a time.
+        // The step by step version may start its last item a bit after the end time, so compare at the time where it stopped.
+        // Tolerance: the mining speed should be within 5% and the number of workers within 1.
+        auto harvester = getHarvesterUnitForRace(race);
+        auto supply = getSupplyUnitForRace(race);
+        BuildState economyState {{
+            { getTownHallForRace(race), 2 },
+            { harvester, 20 },
+        }};
+        economyState.resources.minerals = 50;
+        economyState.baseInfos = { BaseInfo(10800, 1000, 1000), BaseInfo(10800, 1000, 1000) };
+
+        BuildState stepState = economyState;
+        while (stepState.time < 120) {
+            auto item = stepState.foodAvailableInFuture() <= 2 ? supply : harvester;
+            if (!stepState.simulateBuildOrder({ item }, nullptr, false)) break;
+        }
+
+        BuildState fastState = economyState;
+        bool supported = fastState.simulateEconomy(stepState.time);
+        assert(supported);
+        assert(fastState.time == stepState.time);
+
+        float stepMinerals = stepState.miningSpeed().mineralsPerSecond;
+        float fastMinerals = fastState.miningSpeed().mineralsPerSecond;
+        assert(abs(stepMinerals - fastMinerals) <= 0.05f * stepMinerals);
+
+        int stepWorkers = 0, fastWorkers = 0;
+        for (auto& u : stepState.units) if (u.type == harvester) stepWorkers += u.units;
+        for (auto& u : fastState.units) if (u.type == harvester) fastWorkers += u.units;
+        assert(abs(stepWorkers - fastWorkers) <= 1);
+    }
     return 0;
 }
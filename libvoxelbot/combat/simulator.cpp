@@ -9,6 +9,7 @@
 #include <libvoxelbot/utilities/profiler.h>
 #include <libvoxelbot/utilities/stdutils.h>
 #include <libvoxelbot/utilities/predicates.h>
+#include <libvoxelbot/utilities/transposition_table.h>
 #include <libvoxelbot/common/unit_lists.h>
 #include <libvoxelbot/combat/combat_environment.h>
 #include <sstream>
@@ -226,19 +227,39 @@ SurroundInfo maxSurround(float enemyGroundUnitArea, int enemyGroundUnits) {
     return { maxAttackersPerDefender, maxMeleeAttackers };
 }
 
+// Features for the Zobrist hash of a combat. High bits are set to keep them apart from the unit features.
+static const uint64_t ZobristUpgrades = (1ULL << 63) | 1;
+static const uint64_t ZobristTargetUpgrades = (1ULL << 63) | 2;
+static const uint64_t ZobristBadMicro = (1ULL << 63) | 3;
+static const uint64_t ZobristDefenderPlayer = (1ULL << 63) | 4;
+static const uint64_t ZobristMaxTime = (1ULL << 63) | 5;
+
 // Hash for combat input
 unsigned long long combatHash(const CombatState& state, bool badMicro, int defenderPlayer, float maxTime) {
-    unsigned long long h = 0L;
-    h = h ^ defenderPlayer;
-    h = h*31 ^ (int)badMicro;
-    h = h*31 ^ (int)round(maxTime);
-    for (auto& u : state.units) {
-        h = (h * 31) ^ (unsigned long long)u.energy;
-        h = (h * 31) ^ (unsigned long long)u.health;
-        h = (h * 31) ^ (unsigned long long)u.shield;
-        h = (h * 31) ^ (unsigned long long)u.type;
-        h = (h * 31) ^ (unsigned long long)u.owner;
-    }
+    uint64_t h = state.hash();
+    h += zobristKey(ZobristBadMicro, (uint64_t)badMicro);
+    h += zobristKey(ZobristDefenderPlayer, (uint64_t)defenderPlayer);
+    h += zobristKey(ZobristMaxTime, (uint64_t)llround(maxTime));
+    return h;
+}
+
+uint64_t CombatState::unitKey(size_t index, const CombatUnit& unit) {
+    // The order of the units matters to the simulator, so the index is part of the key
+    uint64_t feature = zobristKey(((uint64_t)index << 32) | (uint32_t)unit.owner, (uint64_t)unit.type);
+    // Health, shields and energy are separate features so that different combinations of them cannot cancel out
+    return zobristKey(zobristKey(feature, 0), (uint64_t)llround(unit.health))
+         + zobristKey(zobristKey(feature, 1), (uint64_t)llround(unit.shield))
+         + zobristKey(zobristKey(feature, 2), (uint64_t)llround(unit.energy));
+}
+
+uint64_t CombatState::hash() const {
+    // The environment is completely determined by the upgrades of both players.
+    // Hash those instead of the pointer, so that equal environments give the same hash. No environment is the same as no upgrades.
+    CombatUpgrades noUpgrades;
+    const CombatUpgrades& upgrades0 = environment != nullptr ? environment->upgrades[0] : noUpgrades;
+    const CombatUpgrades& upgrades1 = environment != nullptr ? environment->upgrades[1] : noUpgrades;
+    uint64_t h = zobristKey(ZobristUpgrades, upgrades0.hash()) + zobristKey(ZobristTargetUpgrades, upgrades1.hash());
+    for (size_t i = 0; i < units.size(); i++) h += unitKey(i, units[i]);
     return h;
 }
 
@@ -261,7 +282,7 @@ CombatResult CombatPredictor::predict_engage(const CombatState& inputState, bool
 
 CombatResult CombatPredictor::predict_engage(const CombatState& inputState, CombatSettings settings, CombatRecording* recording, int defenderPlayer) const {
 #if CACHE_COMBAT
-    auto h = combatHash(inputState, badMicro, defenderPlayer);
+    auto h = combatHash(inputState, settings.badMicro, defenderPlayer, settings.maxTime);
     counter++;
     
     // Determine if we have already seen this combat before, and if so, just return the previous outcome
@@ -40,6 +40,16 @@ struct CombatState {
 	// Owner with the highest total health summed over all units
 	int owner_with_best_outcome() const;
 	std::string toString();
+
+	/** Zobrist key of the unit at the given index in #units.
+	 * The hash of the state is the sum of the keys of all units, so code that modifies a single unit
+	 * can keep a hash up to date in O(1) by subtracting the unit's old key and adding the new one.
+	 * Health, shields and energy are quantized to whole points and hashed as separate features.
+	 */
+	static uint64_t unitKey(size_t index, const CombatUnit& unit);
+
+	/** Zobrist hash of all units and the upgrades in the combat environment */
+	uint64_t hash() const;
 };
 
 struct CombatResult {
@@ -1,4 +1,5 @@
 #include <libvoxelbot/combat/simulator.h>
+#include <libvoxelbot/combat/combat_environment.h>
 #include <libvoxelbot/buildorder/build_state.h>
 #include <libvoxelbot/common/unit_lists.h>
 #include <libvoxelbot/buildorder/build_time_estimator.h>
@@ -41,11 +42,41 @@ void unitTestSurround() {
     assert(maxSurround(pow(unitRadius(UNIT_TYPEID::TERRAN_THOR), 2) * PI * 1, 1).maxMeleeAttackers == 10);
 }
 
+void unitTestHash(const CombatPredictor& predictor) {
+    CombatState state {{
+        makeUnit(1, UNIT_TYPEID::PROTOSS_ZEALOT),
+        makeUnit(2, UNIT_TYPEID::TERRAN_MARINE),
+    }};
+
+    // The hash depends on the upgrades in the environment, not on which environment object is used.
+    // No environment is the same as an environment without upgrades.
+    CombatEnvironment env({}, {});
+    state.environment = &env;
+    uint64_t h = state.hash();
+    state.environment = &predictor.defaultCombatEnvironment;
+    assert(state.hash() == h);
+    state.environment = nullptr;
+    assert(state.hash() == h);
+    state.environment = &predictor.getCombatEnvironment({ UPGRADE_ID::PROTOSSGROUNDWEAPONSLEVEL1 }, {});
+    assert(state.hash() != h);
+    state.environment = nullptr;
+
+    // Moving a point from the shields to the health must change the hash
+    CombatState other = state;
+    other.units[0].health += 1;
+    other.units[0].shield -= 1;
+    assert(other.hash() != h);
+
+    // The hash can be updated incrementally using the unit keys
+    assert(h - CombatState::unitKey(0, state.units[0]) + CombatState::unitKey(0, other.units[0]) == other.hash());
+}
+
 int main() {
     initMappings();
     CombatPredictor predictor;
     predictor.init();
     unitTestSurround();
+    unitTestHash(predictor);
 
     assert(combatWinner(predictor, {{
 		makeUnit(1, UNIT_TYPEID::TERRAN_VIKINGFIGHTER),
@@ -1,4 +1,5 @@
 #include <libvoxelbot/common/unit_lists.h>
+#include <iostream>
 
 using namespace std;
 using namespace sc2;
@@ -42,6 +43,121 @@ bool AvailableUnitTypes::canBeChronoBoosted (int index) const {
     return !isStructure(unitType) && isStructure(abilityToCasterUnit(getUnitData(unitType).ability_id)[0]);
 }
 
+void AvailableUnitTypes::initTechTables() {
+    int n = index2item.size();
+    if (n > (int)AvailableUnitMask().size()) {
+        // The tables are only an optimization, the queries fall back to walking the tech tree
+        cerr << "Unit list with " << n << " items is too large for the tech tables (at most " << AvailableUnitMask().size() << " items), the slower dependency checks will be used" << endl;
+        return;
+    }
+
+    hasTechTable = vector<bool>(n, true);
+    directRequirements = vector<AvailableUnitMask>(n);
+    casterRequirements = vector<AvailableUnitMask>(n);
+    transitiveRequirements = vector<AvailableUnitMask>(n);
+    // Dependencies that will be added if they are missing, used to calculate the transitive requirements
+    vector<AvailableUnitMask> dependencyEdges(n);
+
+    // Note: this must be kept in sync with traceDependencies in optimizer.cpp
+    for (int i = 0; i < n; i++) {
+        auto require = [&](BuildOrderItem item) {
+            int index = item.isUnitType() ? getIndexMaybe(item.typeID()) : getIndexMaybe(item.upgradeID());
+            if (index == -1) {
+                hasTechTable[i] = false;
+                return;
+            }
+            directRequirements[i][index] = true;
+            dependencyEdges[i][index] = true;
+        };
+
+        if (index2item[i].isUnitType()) {
+            UNIT_TYPEID unitType = index2item[i].typeID();
+            if (isBasicHarvester(unitType)) continue;
+
+            auto& unitData = getUnitData(unitType);
+            if (unitData.race == Race::Protoss && isStructure(unitType) && unitType != UNIT_TYPEID::PROTOSS_NEXUS && unitType != UNIT_TYPEID::PROTOSS_PYLON && unitType != UNIT_TYPEID::PROTOSS_ASSIMILATOR) {
+                require(BuildOrderItem(UNIT_TYPEID::PROTOSS_PYLON));
+                // traceDependencies continues with the pylon's own requirements
+                unitType = UNIT_TYPEID::PROTOSS_PYLON;
+            }
+
+            auto& data = getUnitData(unitType);
+            if (data.tech_requirement != UNIT_TYPEID::INVALID) {
+                if (data.require_attached) {
+                    if (abilityToCasterUnit(data.ability_id).empty()) {
+                        hasTechTable[i] = false;
+                        continue;
+                    }
+                    require(BuildOrderItem(getSpecificAddonType(abilityToCasterUnit(data.ability_id)[0], data.tech_requirement)));
+                } else {
+                    // The requirement is considered satisfied if any type in the list is tech aliased to it
+                    bool anyAlias = false;
+                    for (auto t : unitTypes) {
+                        for (auto t2 : getUnitData(t).tech_alias) anyAlias |= t2 == data.tech_requirement;
+                    }
+                    if (!anyAlias) require(BuildOrderItem(data.tech_requirement));
+                    // traceDependencies looks up the requirement itself before checking the aliases
+                    else if (getIndexMaybe(data.tech_requirement) == -1) hasTechTable[i] = false;
+                }
+            }
+
+            auto& casters = abilityToCasterUnit(data.ability_id);
+            for (auto caster : casters) {
+                if (caster == UNIT_TYPEID::ZERG_LARVA) {
+                    // Larva is never added as a dependency
+                    casterRequirements[i].reset();
+                    break;
+                }
+
+                int index = getIndexMaybe(caster);
+                if (index == -1) {
+                    hasTechTable[i] = false;
+                    break;
+                }
+                casterRequirements[i][index] = true;
+            }
+            if (casters.size() > 0 && casters[0] != UNIT_TYPEID::ZERG_LARVA && hasTechTable[i]) {
+                dependencyEdges[i][getIndex(casters[0])] = true;
+            }
+        } else {
+            UPGRADE_ID upgrade = index2item[i].upgradeID();
+            auto unitDependency = getUpgradeUnitDependency(upgrade);
+            if (unitDependency != UNIT_TYPEID::INVALID) require(BuildOrderItem(unitDependency));
+
+            auto upgradeDependency = getUpgradeUpgradeDependency(upgrade);
+            if (upgradeDependency != UPGRADE_ID::INVALID) {
+                require(BuildOrderItem(upgradeDependency));
+            } else if (abilityToCasterUnit(getUpgradeData(upgrade).ability_id).size() > 0) {
+                require(BuildOrderItem(abilityToCasterUnit(getUpgradeData(upgrade).ability_id)[0]));
+            } else {
+                hasTechTable[i] = false;
+            }
+        }
+    }
+
+    // Transitive closure. Iterate until convergence, there are very few levels in the tech tree
+    transitiveRequirements = dependencyEdges;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = 0; i < n; i++) {
+            auto closure = transitiveRequirements[i];
+            bool valid = hasTechTable[i];
+            for (int j = 0; j < n; j++) {
+                if (dependencyEdges[i][j]) {
+                    closure |= transitiveRequirements[j];
+                    valid = valid && hasTechTable[j];
+                }
+            }
+            if (closure != transitiveRequirements[i] || valid != hasTechTable[i]) {
+                transitiveRequirements[i] = closure;
+                hasTechTable[i] = valid;
+                changed = true;
+            }
+        }
+    }
+}
+
 static AvailableUnitTypes unitTypesTerranBuildOrder = {
     BuildOrderItem(UNIT_TYPEID::TERRAN_ARMORY),
     BuildOrderItem(UNIT_TYPEID::TERRAN_BANSHEE),
@@ -84,7 +200,7 @@ static AvailableUnitTypes unitTypesTerranBuildOrder = {
     BuildOrderItem(UNIT_TYPEID::TERRAN_WIDOWMINE),
 };
 
-const AvailableUnitTypes unitTypesProtossBuildOrder = {
+static AvailableUnitTypes unitTypesProtossBuildOrder = {
     BuildOrderItem(UNIT_TYPEID::PROTOSS_ADEPT),
     // BuildOrderItem(UNIT_TYPEID::PROTOSS_ADEPTPHASESHIFT),
     // BuildOrderItem(UNIT_TYPEID::PROTOSS_ARCHON, // TODO: Special case creation rul)e
@@ -151,7 +267,7 @@ const AvailableUnitTypes unitTypesProtossBuildOrder = {
     BuildOrderItem(UPGRADE_ID::EXTENDEDTHERMALLANCE),
 };
 
-const AvailableUnitTypes unitTypesZergBuildOrder = {
+static AvailableUnitTypes unitTypesZergBuildOrder = {
     BuildOrderItem(UNIT_TYPEID::ZERG_BANELING),
     BuildOrderItem(UNIT_TYPEID::ZERG_BANELINGNEST),
     BuildOrderItem(UNIT_TYPEID::ZERG_BROODLORD),
@@ -271,7 +387,7 @@ static AvailableUnitTypes unitTypesZergEconomic = {
     BuildOrderItem(UNIT_TYPEID::ZERG_ULTRALISKCAVERN),
 };
 
-const AvailableUnitTypes unitTypesTerranCombat = {
+static AvailableUnitTypes unitTypesTerranCombat = {
     BuildOrderItem(UNIT_TYPEID::TERRAN_LIBERATOR),
     // BuildOrderItem(UNIT_TYPEID::TERRAN_BATTLECRUISER),
     BuildOrderItem(UNIT_TYPEID::TERRAN_BANSHEE),
@@ -297,7 +413,7 @@ const AvailableUnitTypes unitTypesTerranCombat = {
     // BuildOrderItem(UNIT_TYPEID::TERRAN_WIDOWMINEBURROWED),
 };
 
-const AvailableUnitTypes unitTypesProtossCombat = {
+static AvailableUnitTypes unitTypesProtossCombat = {
     BuildOrderItem(UNIT_TYPEID::PROTOSS_ADEPT),
     // Archon needs special rules before it is supported by the build optimizer
     BuildOrderItem(UNIT_TYPEID::PROTOSS_ARCHON),
@@ -329,7 +445,7 @@ const AvailableUnitTypes unitTypesProtossCombat = {
     BuildOrderItem(UPGRADE_ID::EXTENDEDTHERMALLANCE),
 };
 
-const AvailableUnitTypes unitTypesZergCombat = {
+static AvailableUnitTypes unitTypesZergCombat = {
     BuildOrderItem(UNIT_TYPEID::ZERG_BANELING),
     BuildOrderItem(UNIT_TYPEID::ZERG_BROODLORD),
     BuildOrderItem(UNIT_TYPEID::ZERG_CORRUPTOR),
@@ -354,6 +470,12 @@ const AvailableUnitTypes unitTypesZergCombat = {
 };
 
 
+void initAvailableUnitTypesTechTables() {
+    for (auto* list : { &unitTypesTerranBuildOrder, &unitTypesProtossBuildOrder, &unitTypesZergBuildOrder, &unitTypesTerranEconomic, &unitTypesProtossEconomic, &unitTypesZergEconomic, &unitTypesTerranCombat, &unitTypesProtossCombat, &unitTypesZergCombat }) {
+        list->initTechTables();
+    }
+}
+
 const AvailableUnitTypes& getAvailableUnitsForRace (Race race) {
     return race == Race::Terran ? unitTypesTerranBuildOrder : (race == Race::Protoss ? unitTypesProtossBuildOrder : unitTypesZergBuildOrder);
 }
@@ -1,8 +1,12 @@
 #pragma once
+#include <bitset>
 #include "sc2api/sc2_interfaces.h"
 #include <libvoxelbot/buildorder/optimizer.h>
 #include <libvoxelbot/utilities/predicates.h>
 
+/** Set of indices into an AvailableUnitTypes list */
+typedef std::bitset<128> AvailableUnitMask;
+
 struct AvailableUnitTypes {
     std::vector<BuildOrderItem> index2item;
     std::vector<int> type2index;
@@ -10,6 +14,12 @@ struct AvailableUnitTypes {
     std::map<int, int> arbitraryType2index;
   private:
     std::vector<sc2::UNIT_TYPEID> unitTypes;
+
+    // Tech tables, see #initTechTables
+    std::vector<bool> hasTechTable;
+    std::vector<AvailableUnitMask> directRequirements;
+    std::vector<AvailableUnitMask> casterRequirements;
+    std::vector<AvailableUnitMask> transitiveRequirements;
   public:
 
     size_t size() const {
@@ -97,8 +107,8 @@ struct AvailableUnitTypes {
     }
 
     BuildOrderItem getBuildOrderItem (const GeneUnitType item) const {
-        auto itm = index2item[item.type];
-        itm.chronoBoosted = item.chronoBoosted;
+        auto itm = index2item[item.type()];
+        itm.chronoBoosted = item.chronoBoosted();
         return itm;
     }
 
@@ -106,6 +116,44 @@ struct AvailableUnitTypes {
         return GeneUnitType(arbitraryType2index.at((int)item.rawType()), item.chronoBoosted);
     }
 
+    /** Precomputes which other items each item in the list depends on.
+     * Requires the mappings to be initialized. This is called by initMappings for the built-in lists, other lists need to call it manually to get the faster queries.
+     * The dependencies are the same ones that the build order optimizer adds as implicit steps.
+     * Items which depend on types that are not part of the list do not get any tables.
+     * Lists with more items than fit in an #AvailableUnitMask do not get any tables either, a warning is logged in that case.
+     */
+    void initTechTables();
+
+    /** Mask of all items that the player has at least one of */
+    AvailableUnitMask ownedMask(const std::vector<int>& unitCounts) const {
+        AvailableUnitMask mask;
+        for (size_t i = 0; i < unitCounts.size() && i < mask.size(); i++) mask[i] = unitCounts[i] > 0;
+        return mask;
+    }
+
+    /** True if the item with the given index can be built/researched without any additional tech buildings, addons or casters.
+     * The owned mask contains all items that the player has at least one of.
+     * If this returns false, some dependencies may still be satisfied (e.g. if the tech tables are not available for this list).
+     */
+    bool dependenciesSatisfied(int index, const AvailableUnitMask& owned) const {
+        if (!hasTechTables(index)) return false;
+        if ((directRequirements[index] & ~owned).any()) return false;
+        return casterRequirements[index].none() || (casterRequirements[index] & owned).any();
+    }
+
+    /** All items that are (directly or indirectly) required for the item with the given index, but which the player does not have yet.
+     * Only valid if #hasTechTables is true for the index.
+     * Note that for items with several possible casters the first caster is assumed, which is the one that the optimizer would add.
+     */
+    AvailableUnitMask missingDependencies(int index, const AvailableUnitMask& owned) const {
+        assert(hasTechTables(index));
+        return transitiveRequirements[index] & ~owned;
+    }
+
+    bool hasTechTables(int index) const {
+        return index < (int)hasTechTable.size() && hasTechTable[index];
+    }
+
     friend int remapAvailableUnitIndex(int index, const AvailableUnitTypes& from, const AvailableUnitTypes& to) {
         assert(index < (int)from.index2item.size());
         return to.arbitraryType2index.at((int)from.index2item[index].rawType());
@@ -122,4 +170,7 @@ enum class UnitCategory {
 const AvailableUnitTypes& getAvailableUnitsForRace (sc2::Race race);
 const AvailableUnitTypes& getAvailableUnitsForRace (sc2::Race race, UnitCategory category);
 
-extern const AvailableUnitTypes availableUpgrades;
\ No newline at end of file
+extern const AvailableUnitTypes availableUpgrades;
+
+/** Precomputes the tech tables for all built-in unit lists. Called by initMappings. */
+void initAvailableUnitTypesTechTables();
\ No newline at end of file
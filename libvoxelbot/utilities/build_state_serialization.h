@@ -110,4 +110,5 @@ void serialize(Archive& archive, BuildState& state) {
         cereal::make_nvp("chronoInfo", state.chronoInfo),
         cereal::make_nvp("upgrades", state.upgrades)
     );
+    state.onEventsModified();
 }
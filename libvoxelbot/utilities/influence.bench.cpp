@@ -0,0 +1,167 @@
+/** Benchmarks for the influence map operations.
+ *
+ * Runs the element-wise operations on maps of the sizes used by ladder maps, for both float and double maps,
+ * and prints one JSON object per line with the results.
+ * The "scalar" benchmarks are plain loops over the weights, for comparison with the vectorized operations.
+ * Pass --quick to run fewer repetitions (useful to check that everything works).
+ */
+#include <libvoxelbot/utilities/influence.h>
+#include <libvoxelbot/utilities/profiler.h>
+#include <libvoxelbot/utilities/thread_pool.h>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+
+using namespace std;
+using namespace sc2;
+
+// Prevents the compiler from optimizing away the results
+static volatile double sink;
+
+template <class Fn>
+static double runBenchmark(int evaluations, Fn fn) {
+    // Warm up caches
+    fn();
+
+    Stopwatch watch;
+    for (int i = 0; i < evaluations; i++) fn();
+    watch.stop();
+    return watch.millis();
+}
+
+static void report(const string& benchmark, const string& type, int size, int evaluations, double millis) {
+    double cellsPerSecond = (double)size * size * evaluations / (millis / 1000.0);
+    cout << "{"
+        << "\"benchmark\": \"" << benchmark << "\", "
+        << "\"type\": \"" << type << "\", "
+        << "\"size\": " << size << ", "
+        << "\"evaluations\": " << evaluations << ", "
+        << "\"us_per_eval\": " << (1000.0 * millis / evaluations) << ", "
+        << "\"mcells_per_sec\": " << (cellsPerSecond / 1e6)
+        << "}" << endl;
+}
+
+template <class T>
+static InfluenceMapT<T> randomMap(int size, default_random_engine& rnd) {
+    uniform_real_distribution<T> dist(0, 10);
+    InfluenceMapT<T> map(size, size);
+    for (auto& w : map.weights) w = dist(rnd);
+    return map;
+}
+
+template <class T>
+static void runBenchmarks(const string& type, int size, int evaluations, ThreadPool& pool) {
+    default_random_engine rnd(size);
+    InfluenceMapT<T> a = randomMap<T>(size, rnd);
+    InfluenceMapT<T> b = randomMap<T>(size, rnd);
+    InfluenceMapT<T> c = randomMap<T>(size, rnd);
+    InfluenceMapT<T> traversable = randomMap<T>(size, rnd);
+    traversable.threshold(1);
+    InfluenceMapT<T> result(size, size);
+
+    report("scalar_add_assign", type, size, evaluations, runBenchmark(evaluations, [&]() {
+        for (int i = 0; i < size * size; i++) result.weights[i] += a.weights[i];
+    }));
+    report("add_assign", type, size, evaluations, runBenchmark(evaluations, [&]() {
+        result += a;
+    }));
+
+    report("add", type, size, evaluations, runBenchmark(evaluations, [&]() {
+        result = a + b;
+    }));
+
+    report("scalar_multiply_add", type, size, evaluations, runBenchmark(evaluations, [&]() {
+        for (int i = 0; i < size * size; i++) result.weights[i] = a.weights[i] * b.weights[i] + c.weights[i];
+    }));
+    report("multiply_add_operators", type, size, evaluations, runBenchmark(evaluations, [&]() {
+        result = a * b + c;
+    }));
+    report("multiply_add_fused", type, size, evaluations, runBenchmark(evaluations, [&]() {
+        result.setMultiplyAdd(a, b, c);
+    }));
+
+    report("scalar_sum", type, size, evaluations, runBenchmark(evaluations, [&]() {
+        double s = 0;
+        for (int i = 0; i < size * size; i++) s += a.weights[i];
+        sink = s;
+    }));
+    report("sum", type, size, evaluations, runBenchmark(evaluations, [&]() {
+        sink = a.sum();
+    }));
+
+    report("scalar_max", type, size, evaluations, runBenchmark(evaluations, [&]() {
+        T m = 0;
+        for (int i = 0; i < size * size; i++) m = std::max(m, a.weights[i]);
+        sink = m;
+    }));
+    report("max", type, size, evaluations, runBenchmark(evaluations, [&]() {
+        sink = a.max();
+    }));
+
+    report("argmax", type, size, evaluations, runBenchmark(evaluations, [&]() {
+        sink = a.argmax().x;
+    }));
+
+    report("threshold", type, size, evaluations, runBenchmark(evaluations, [&]() {
+        result = a;
+        result.threshold(5);
+    }));
+
+    report("replace_nan", type, size, evaluations, runBenchmark(evaluations, [&]() {
+        result = a.replace_nan(0);
+    }));
+
+    report("propagateMax", type, size, evaluations, runBenchmark(evaluations, [&]() {
+        result = a;
+        result.propagateMax(0.1, 0.5, traversable);
+    }));
+
+    report("propagateSum", type, size, evaluations, runBenchmark(evaluations, [&]() {
+        result = a;
+        result.propagateSum(0.1, 0.5, traversable);
+    }));
+
+    // Note: these run 8 steps per evaluation
+    report("propagateMax_8_separate", type, size, evaluations, runBenchmark(evaluations, [&]() {
+        result = a;
+        for (int i = 0; i < 8; i++) result.propagateMax(0.1, 0.5, traversable);
+    }));
+    report("propagateMax_8_fused", type, size, evaluations, runBenchmark(evaluations, [&]() {
+        result = a;
+        result.propagateMax(0.1, 0.5, traversable, 8);
+    }));
+    report("propagateMax_8_fused_threads", type, size, evaluations, runBenchmark(evaluations, [&]() {
+        result = a;
+        result.propagateMax(0.1, 0.5, traversable, 8, &pool);
+    }));
+
+    // Spreading a few point sources as far as they go. The iterative version needs about one step per cell of distance
+    InfluenceMapT<T> sources(size, size);
+    for (int i = 0; i < 10; i++) sources(rnd() % size, rnd() % size) = 10;
+    report("propagateMax_30_separate", type, size, evaluations, runBenchmark(evaluations, [&]() {
+        result = sources;
+        for (int i = 0; i < 30; i++) result.propagateMax(0.1, 1, traversable);
+    }));
+    report("propagateMaxUntilConvergence", type, size, evaluations, runBenchmark(evaluations, [&]() {
+        result = sources;
+        result.propagateMaxUntilConvergence(0.1, traversable);
+    }));
+}
+
+int main(int argc, char** argv) {
+    bool quick = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quick") == 0) quick = true;
+    }
+
+    ThreadPool pool(0);
+    for (int size : { 64, 128, 200, 256 }) {
+        // Roughly the same total amount of work for each size
+        int evaluations = max(1, (quick ? 20 : 2000) * 128 * 128 / (size * size));
+        runBenchmarks<float>("float", size, evaluations, pool);
+        runBenchmarks<double>("double", size, evaluations, pool);
+    }
+
+    return 0;
+}
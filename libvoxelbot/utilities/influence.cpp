@@ -1,4 +1,6 @@
 #include <libvoxelbot/utilities/influence.h>
+#include <libvoxelbot/utilities/simd.h>
+#include <libvoxelbot/utilities/thread_pool.h>
 #include <cmath>
 #include <ctime>
 #include <iomanip>
@@ -10,8 +12,9 @@
 using namespace std;
 using namespace sc2;
 
-InfluenceMap::InfluenceMap(const sc2::ImageData map)
-    : InfluenceMap(map.width, map.height) {
+template<class T>
+InfluenceMapT<T>::InfluenceMapT(const sc2::ImageData map)
+    : InfluenceMapT(map.width, map.height) {
     assert(map.bits_per_pixel == 8);
     for (int y = 0; y < h; y++) {
         for (int x = 0; x < w; x++) {
@@ -20,8 +23,9 @@ InfluenceMap::InfluenceMap(const sc2::ImageData map)
     }
 }
 
-InfluenceMap::InfluenceMap(const SC2APIProtocol::ImageData map)
-    : InfluenceMap(map.size().x(), map.size().y()) {
+template<class T>
+InfluenceMapT<T>::InfluenceMapT(const SC2APIProtocol::ImageData map)
+    : InfluenceMapT(map.size().x(), map.size().y()) {
     auto& data = map.data();
     for (int y = 0; y < h; y++) {
         for (int x = 0; x < w; x++) {
@@ -34,193 +38,218 @@ static pair<int, int> round_point(Point2D p) {
     return make_pair((int)round(p.x), (int)round(p.y));
 }
 
-InfluenceMap& InfluenceMap::operator+=(const InfluenceMap& other) {
-    for (int i = 0; i < w * h; i++) {
-        weights[i] += other.weights[i];
-    }
+template<class T>
+InfluenceMapT<T>& InfluenceMapT<T>::operator+=(const InfluenceMapT& other) {
+    SimdOps<T>::add(weights.data(), weights.data(), other.weights.data(), w * h);
     return (*this);
 }
 
-InfluenceMap& InfluenceMap::operator+=(double other) {
-    for (int i = 0; i < w * h; i++) {
-        weights[i] += other;
-    }
+template<class T>
+InfluenceMapT<T>& InfluenceMapT<T>::operator+=(T other) {
+    SimdOps<T>::addScalar(weights.data(), weights.data(), other, w * h);
     return (*this);
 }
 
-InfluenceMap InfluenceMap::operator+(const InfluenceMap& other) const {
-    auto ret = (*this);
-    return (ret += other);
+template<class T>
+InfluenceMapT<T> InfluenceMapT<T>::operator+(const InfluenceMapT& other) const {
+    InfluenceMapT ret(w, h);
+    SimdOps<T>::add(ret.weights.data(), weights.data(), other.weights.data(), w * h);
+    return ret;
 }
 
-InfluenceMap& InfluenceMap::operator-=(const InfluenceMap& other) {
+template<class T>
+InfluenceMapT<T>& InfluenceMapT<T>::operator-=(const InfluenceMapT& other) {
     assert(w == other.w);
     assert(h == other.h);
 
-    for (int i = 0; i < w * h; i++) {
-        weights[i] -= other.weights[i];
-    }
+    SimdOps<T>::subtract(weights.data(), weights.data(), other.weights.data(), w * h);
     return (*this);
 }
 
-InfluenceMap InfluenceMap::operator-(const InfluenceMap& other) const {
-    auto ret = (*this);
-    return (ret -= other);
+template<class T>
+InfluenceMapT<T> InfluenceMapT<T>::operator-(const InfluenceMapT& other) const {
+    assert(w == other.w);
+    assert(h == other.h);
+
+    InfluenceMapT ret(w, h);
+    SimdOps<T>::subtract(ret.weights.data(), weights.data(), other.weights.data(), w * h);
+    return ret;
 }
 
-InfluenceMap& InfluenceMap::operator*=(const InfluenceMap& other) {
+template<class T>
+InfluenceMapT<T>& InfluenceMapT<T>::operator*=(const InfluenceMapT& other) {
     assert(w == other.w);
     assert(h == other.h);
-    for (int i = 0; i < w * h; i++) {
-        weights[i] *= other.weights[i];
-    }
+
+    SimdOps<T>::multiply(weights.data(), weights.data(), other.weights.data(), w * h);
     return (*this);
 }
 
-InfluenceMap InfluenceMap::operator*(const InfluenceMap& other) const {
-    auto ret = (*this);
-    return (ret *= other);
+template<class T>
+InfluenceMapT<T> InfluenceMapT<T>::operator*(const InfluenceMapT& other) const {
+    assert(w == other.w);
+    assert(h == other.h);
+
+    InfluenceMapT ret(w, h);
+    SimdOps<T>::multiply(ret.weights.data(), weights.data(), other.weights.data(), w * h);
+    return ret;
 }
 
-InfluenceMap& InfluenceMap::operator/=(const InfluenceMap& other) {
+template<class T>
+InfluenceMapT<T>& InfluenceMapT<T>::operator/=(const InfluenceMapT& other) {
     assert(w == other.w);
     assert(h == other.h);
 
-    for (int i = 0; i < w * h; i++) {
-        weights[i] /= other.weights[i];
-    }
+    SimdOps<T>::divide(weights.data(), weights.data(), other.weights.data(), w * h);
     return (*this);
 }
 
-InfluenceMap InfluenceMap::operator/(const InfluenceMap& other) const {
-    auto ret = (*this);
-    return (ret /= other);
+template<class T>
+InfluenceMapT<T> InfluenceMapT<T>::operator/(const InfluenceMapT& other) const {
+    assert(w == other.w);
+    assert(h == other.h);
+
+    InfluenceMapT ret(w, h);
+    SimdOps<T>::divide(ret.weights.data(), weights.data(), other.weights.data(), w * h);
+    return ret;
 }
 
-InfluenceMap InfluenceMap::operator+(double factor) const {
-    InfluenceMap ret = InfluenceMap(w, h);
-    for (int i = 0; i < w * h; i++) {
-        ret.weights[i] = weights[i] + factor;
-    }
+template<class T>
+InfluenceMapT<T> InfluenceMapT<T>::operator+(T factor) const {
+    InfluenceMapT ret(w, h);
+    SimdOps<T>::addScalar(ret.weights.data(), weights.data(), factor, w * h);
     return ret;
 }
 
-InfluenceMap InfluenceMap::operator-(double factor) const {
-    InfluenceMap ret = InfluenceMap(w, h);
-    for (int i = 0; i < w * h; i++) {
-        ret.weights[i] = weights[i] - factor;
-    }
+template<class T>
+InfluenceMapT<T> InfluenceMapT<T>::operator-(T factor) const {
+    InfluenceMapT ret(w, h);
+    SimdOps<T>::addScalar(ret.weights.data(), weights.data(), -factor, w * h);
     return ret;
 }
 
-InfluenceMap InfluenceMap::operator*(double factor) const {
-    InfluenceMap ret = InfluenceMap(w, h);
-    for (int i = 0; i < w * h; i++) {
-        ret.weights[i] = weights[i] * factor;
-    }
+template<class T>
+InfluenceMapT<T> InfluenceMapT<T>::operator*(T factor) const {
+    InfluenceMapT ret(w, h);
+    SimdOps<T>::multiplyScalar(ret.weights.data(), weights.data(), factor, w * h);
     return ret;
 }
 
-void InfluenceMap::operator*=(double factor) {
-    for (int i = 0; i < w * h; i++) {
-        weights[i] *= factor;
-    }
+template<class T>
+void InfluenceMapT<T>::operator*=(T factor) {
+    SimdOps<T>::multiplyScalar(weights.data(), weights.data(), factor, w * h);
 }
 
-void InfluenceMap::threshold(double value) {
-    for (int i = 0; i < w * h; i++)
-        weights[i] = weights[i] >= value ? 1 : 0;
+template<class T>
+void InfluenceMapT<T>::setMultiplyAdd(const InfluenceMapT& a, const InfluenceMapT& b, const InfluenceMapT& c) {
+    assert(a.w == b.w && a.w == c.w);
+    assert(a.h == b.h && a.h == c.h);
+
+    w = a.w;
+    h = a.h;
+    weights.resize(w * h);
+    SimdOps<T>::multiplyAdd(weights.data(), a.weights.data(), b.weights.data(), c.weights.data(), w * h);
 }
 
-double InfluenceMap::sum() const {
-    double ret = 0.0;
-    for (int y = 0; y < h; y++) {
-        for (int x = 0; x < w; x++) {
-            ret += weights[y * w + x];
-        }
-    }
-    return ret;
+template<class T>
+void InfluenceMapT<T>::addMultiple(const InfluenceMapT& other, T factor) {
+    assert(w == other.w);
+    assert(h == other.h);
+
+    SimdOps<T>::multiplyScalarAdd(weights.data(), other.weights.data(), factor, weights.data(), w * h);
 }
 
-void InfluenceMap::max(const InfluenceMap& other) {
-    for (int i = 0; i < w*h; i++) {
-        weights[i] = std::max(weights[i], other.weights[i]);
-    }
+template<class T>
+void InfluenceMapT<T>::multiplyAdd(T factor, T offset) {
+    SimdOps<T>::multiplyScalarAddScalar(weights.data(), weights.data(), factor, offset, w * h);
 }
 
-double InfluenceMap::max() const {
-    double ret = 0.0;
-    for (int i = 0; i < w * h; i++) {
-        ret = std::max(ret, weights[i]);
-    }
-    return ret;
+template<class T>
+void InfluenceMapT<T>::threshold(T value) {
+    SimdOps<T>::threshold(weights.data(), weights.data(), value, w * h);
 }
 
-double InfluenceMap::maxFinite() const {
-    double ret = 0.0;
-    for (auto w : weights) {
-        if (isfinite(w))
-            ret = std::max(ret, w);
-    }
-    return ret;
+template<class T>
+double InfluenceMapT<T>::sum() const {
+    return SimdOps<T>::sum(weights.data(), w * h);
 }
 
-Point2DI InfluenceMap::argmax() const {
-    double mx = -100000;
-    Point2DI best(0, 0);
-    for (int y = 0; y < h; y++) {
-        for (int x = 0; x < w; x++) {
-            if (weights[y * w + x] > mx && isfinite(weights[y * w + x])) {
-                mx = weights[y * w + x];
-                best = Point2DI(x, y);
-            }
+template<class T>
+void InfluenceMapT<T>::max(const InfluenceMapT& other) {
+    SimdOps<T>::maximum(weights.data(), weights.data(), other.weights.data(), w * h);
+}
+
+template<class T>
+T InfluenceMapT<T>::max() const {
+    return SimdOps<T>::max(weights.data(), w * h, 0);
+}
+
+template<class T>
+T InfluenceMapT<T>::maxFinite() const {
+    return SimdOps<T>::maxFinite(weights.data(), weights.size(), 0);
+}
+
+template<class T>
+Point2DI InfluenceMapT<T>::argmax() const {
+    // Find the maximum value first, and then the first cell with that value.
+    // This is equivalent to picking the first cell which is larger than all previous cells.
+    T mn = -100000;
+    T mx = SimdOps<T>::maxFinite(weights.data(), w * h, mn);
+    if (mx > mn) {
+        for (int i = 0; i < w * h; i++) {
+            if (weights[i] == mx) return Point2DI(i % w, i / w);
         }
     }
-    return best;
+    return Point2DI(0, 0);
 }
 
-InfluenceMap InfluenceMap::replace_nonzero(double with) const {
-    InfluenceMap ret = InfluenceMap(w, h);
+template<class T>
+InfluenceMapT<T> InfluenceMapT<T>::replace_nonzero(T with) const {
+    InfluenceMapT ret = InfluenceMapT(w, h);
     for (int i = 0; i < w * h; i++) {
         ret.weights[i] = weights[i] != 0 ? with : 0;
     }
     return ret;
 }
 
-InfluenceMap InfluenceMap::replace_nan(double with) const {
-    InfluenceMap ret = InfluenceMap(w, h);
-    for (int i = 0; i < w * h; i++) {
-        ret.weights[i] = isnan(weights[i]) ? with : weights[i];
-    }
+template<class T>
+InfluenceMapT<T> InfluenceMapT<T>::replace_nan(T with) const {
+    InfluenceMapT ret(w, h);
+    SimdOps<T>::replaceNan(ret.weights.data(), weights.data(), with, w * h);
     return ret;
 }
 
-InfluenceMap InfluenceMap::replace(double value, double with) const {
-    InfluenceMap ret = InfluenceMap(w, h);
+template<class T>
+InfluenceMapT<T> InfluenceMapT<T>::replace(T value, T with) const {
+    InfluenceMapT ret = InfluenceMapT(w, h);
     for (int i = 0; i < w * h; i++) {
         ret.weights[i] = weights[i] == value ? with : weights[i];
     }
     return ret;
 }
 
-void InfluenceMap::addInfluence(double influence, Point2DI pos) {
+template<class T>
+void InfluenceMapT<T>::addInfluence(T influence, Point2DI pos) {
     assert(pos.x >= 0 && pos.x < w && pos.y >= 0 && pos.y < h);
     weights[pos.y * w + pos.x] += influence;
 }
 
-void InfluenceMap::addInfluence(double influence, Point2D pos) {
+template<class T>
+void InfluenceMapT<T>::addInfluence(T influence, Point2D pos) {
     auto p = round_point(pos);
     assert(p.first >= 0 && p.first < w && p.second >= 0 && p.second < h);
     weights[p.second * w + p.first] += influence;
 }
 
-void InfluenceMap::setInfluence(double influence, Point2D pos) {
+template<class T>
+void InfluenceMapT<T>::setInfluence(T influence, Point2D pos) {
     auto p = round_point(pos);
     assert(p.first >= 0 && p.first < w && p.second >= 0 && p.second < h);
     weights[p.second * w + p.first] = influence;
 }
 
-void InfluenceMap::addInfluenceInDecayingCircle(double influence, double radius, Point2D pos) {
+template<class T>
+void InfluenceMapT<T>::addInfluenceInDecayingCircle(T influence, T radius, Point2D pos) {
     int x0, y0;
     tie(x0, y0) = round_point(pos);
 
@@ -236,7 +265,8 @@ void InfluenceMap::addInfluenceInDecayingCircle(double influence, double radius,
     }
 }
 
-void InfluenceMap::setInfluenceInCircle(double influence, double radius, Point2D pos) {
+template<class T>
+void InfluenceMapT<T>::setInfluenceInCircle(T influence, T radius, Point2D pos) {
     int x0, y0;
     tie(x0, y0) = round_point(pos);
 
@@ -252,7 +282,8 @@ void InfluenceMap::setInfluenceInCircle(double influence, double radius, Point2D
     }
 }
 
-void InfluenceMap::addInfluence(const vector<vector<double> >& influence, Point2D pos) {
+template<class T>
+void InfluenceMapT<T>::addInfluence(const vector<vector<double> >& influence, Point2D pos) {
     int x0, y0;
     tie(x0, y0) = round_point(pos);
 
@@ -268,7 +299,8 @@ void InfluenceMap::addInfluence(const vector<vector<double> >& influence, Point2
     }
 }
 
-void InfluenceMap::addInfluenceMultiple(const vector<vector<double> >& influence, Point2D pos, double factor) {
+template<class T>
+void InfluenceMapT<T>::addInfluenceMultiple(const vector<vector<double> >& influence, Point2D pos, double factor) {
     int x0, y0;
     tie(x0, y0) = round_point(pos);
 
@@ -284,7 +316,8 @@ void InfluenceMap::addInfluenceMultiple(const vector<vector<double> >& influence
     }
 }
 
-void InfluenceMap::maxInfluence(const vector<vector<double> >& influence, Point2D pos) {
+template<class T>
+void InfluenceMapT<T>::maxInfluence(const vector<vector<double> >& influence, Point2D pos) {
     int x0, y0;
     tie(x0, y0) = round_point(pos);
 
@@ -294,13 +327,14 @@ void InfluenceMap::maxInfluence(const vector<vector<double> >& influence, Point2
             int x = x0 + dx;
             int y = y0 + dy;
             if (x >= 0 && y >= 0 && x < w && y < h) {
-                weights[y * w + x] = std::max(weights[y * w + x], influence[dx + r][dy + r]);
+                weights[y * w + x] = std::max(weights[y * w + x], (T)influence[dx + r][dy + r]);
             }
         }
     }
 }
 
-void InfluenceMap::maxInfluenceMultiple(const vector<vector<double> >& influence, Point2D pos, double factor) {
+template<class T>
+void InfluenceMapT<T>::maxInfluenceMultiple(const vector<vector<double> >& influence, Point2D pos, double factor) {
     int x0, y0;
     tie(x0, y0) = round_point(pos);
 
@@ -310,130 +344,296 @@ void InfluenceMap::maxInfluenceMultiple(const vector<vector<double> >& influence
             int x = x0 + dx;
             int y = y0 + dy;
             if (x >= 0 && y >= 0 && x < w && y < h) {
-                weights[y * w + x] = std::max(weights[y * w + x], influence[dx + r][dy + r] * factor);
+                weights[y * w + x] = std::max(weights[y * w + x], (T)(influence[dx + r][dy + r] * factor));
             }
         }
     }
 }
 
-vector<double> temporary_buffer;
-void InfluenceMap::propagateMax(double decay, double speed, const InfluenceMap& traversable) {
-    double factor = 1 - decay;
+/** Scratch buffers for the propagation functions.
+ * There is one set of buffers per thread and element type, so maps can be propagated on several threads at the same time.
+ */
+template<class T>
+static vector<T>& scratchBuffer(int index) {
+    thread_local vector<T> buffers[2];
+    return buffers[index];
+}
+
+/** One step of the max propagation for a single row. Reads from the rows above and below the given row as well */
+template<class T>
+struct PropagateMaxKernel {
+    T factor;
     // Diagonal decay
-    double factor2 = pow(factor, 1.41);
+    T factor2;
+    T speed;
+
+    PropagateMaxKernel(T decay, T speed) : factor(1 - decay), factor2(pow(factor, (T)1.41)), speed(speed) {}
+
+    void operator()(T* out, const T* in, const T* traversable, int w) const {
+        simdLoop<T>(w - 2, [&](auto tag, int j) {
+            typedef decltype(tag) V;
+            int i = j + 1;
+            V zero = V::set1(0);
+            V center = V::load(in + i);
+
+            V c = V::max(center, zero);
+            c = V::max(V::load(in + i - 1), c);
+            c = V::max(V::load(in + i + 1), c);
+            c = V::max(V::load(in + i - w), c);
+            c = V::max(V::load(in + i + w), c);
+            c = V::mul(c, V::set1(factor));
+
+            V c2 = V::max(V::load(in + i - w - 1), zero);
+            c2 = V::max(V::load(in + i - w + 1), c2);
+            c2 = V::max(V::load(in + i + w - 1), c2);
+            c2 = V::max(V::load(in + i + w + 1), c2);
+            c2 = V::mul(c2, V::set1(factor2));
+            c = V::max(c2, c);
+
+            c = V::add(V::mul(c, V::set1(speed)), V::mul(V::set1(1 - speed), center));
+            V::select(V::equal(V::load(traversable + i), zero), zero, c).store(out + i);
+        });
+    }
+};
+
+/** One step of the sum propagation for a single row. Reads from the rows above and below the given row as well */
+template<class T>
+struct PropagateSumKernel {
+    T factor;
+    T speed;
+    T gaussianFactor0 = 1;     //0.195346;
+    T gaussianFactor1 = 1;     //0.123317;
+    T gaussianFactor2 = 0.75;  //0.077847;
+
+    PropagateSumKernel(T decay, T speed) : factor(1 - decay), speed(speed) {}
+
+    void operator()(T* out, const T* in, const T* traversable, int w) const {
+        simdLoop<T>(w - 2, [&](auto tag, int j) {
+            typedef decltype(tag) V;
+            int i = j + 1;
+            V zero = V::set1(0);
+            V center = V::load(in + i);
+
+            V adjacentTraversable = V::add(V::add(V::add(V::load(traversable + i - 1), V::load(traversable + i + 1)), V::load(traversable + i - w)), V::load(traversable + i + w));
+            V diagonalTraversable = V::add(V::add(V::add(V::load(traversable + i - w - 1), V::load(traversable + i - w + 1)), V::load(traversable + i + w - 1)), V::load(traversable + i + w + 1));
+            V neighbours = V::add(V::set1(gaussianFactor0), V::add(V::mul(V::set1(gaussianFactor1), adjacentTraversable), V::mul(V::set1(gaussianFactor2), diagonalTraversable)));
+
+            V c = V::add(zero, V::load(in + i - 1));
+            c = V::add(c, V::load(in + i + 1));
+            c = V::add(c, V::load(in + i - w));
+            c = V::add(c, V::load(in + i + w));
+            c = V::mul(c, V::set1(gaussianFactor1));
+
+            c = V::add(c, V::mul(center, V::set1(gaussianFactor0)));
+
+            V c2 = V::add(zero, V::load(in + i - w - 1));
+            c2 = V::add(c2, V::load(in + i - w + 1));
+            c2 = V::add(c2, V::load(in + i + w - 1));
+            c2 = V::add(c2, V::load(in + i + w + 1));
+            c2 = V::mul(c2, V::set1(gaussianFactor2));
+            c = V::add(c, c2);
 
-    temporary_buffer.resize(weights.size());
-    vector<double>& newWeights = temporary_buffer;
+            // To prevent the total weight values from increasing unbounded
+            c = V::select(V::greater(neighbours, zero), V::div(c, neighbours), c);
 
-    for (int y = 0; y < h; y++) {
-        weights[y * w + 0] = weights[y * w + 1];
-        weights[y * w + w - 1] = weights[y * w + w - 2];
-    }
-    for (int x = 0; x < w; x++) {
-        weights[x] = weights[x + w];
-        weights[(h - 1) * w + x] = weights[(h - 2) * w + x];
+            c = V::add(V::mul(c, V::set1(speed)), V::mul(V::set1(1 - speed), center));
+            c = V::mul(c, V::set1(factor));
+            V::select(V::equal(V::load(traversable + i), zero), zero, c).store(out + i);
+        });
     }
+};
 
-    for (int y = 1; y < h - 1; y++) {
-        int yw = y * w;
-        for (int x = 1; x < w - 1; x++) {
-            int i = yw + x;
-            if (traversable[i] == 0) {
-                newWeights[i] = 0;
-                continue;
-            }
-
-            double c = 0;
-            c = std::max(c, weights[i]);
-            c = std::max(c, weights[i - 1]);
-            c = std::max(c, weights[i + 1]);
-            c = std::max(c, weights[i - w]);
-            c = std::max(c, weights[i + w]);
-            c *= factor;
-
-            double c2 = 0;
-            c2 = std::max(c2, weights[i - w - 1]);
-            c2 = std::max(c2, weights[i - w + 1]);
-            c2 = std::max(c2, weights[i + w - 1]);
-            c2 = std::max(c2, weights[i + w + 1]);
-            c2 *= factor2;
-            c = std::max(c, c2);
-
-            c = c * speed + (1 - speed) * weights[i];
-            newWeights[i] = c;
+/** Runs one propagation step on a band of rows.
+ * Only rows in the range [firstRow, lastRow) are written to the output.
+ * The first and last rows of the band are only read, they are copied unchanged to the output.
+ * If the band includes the top or bottom edge of the map, that edge is first set to the adjacent row,
+ * and the left and right edges are always set to the adjacent column (this modifies the input).
+ */
+template<class T, class Kernel>
+static void propagateStep(T* in, T* out, const T* traversable, int w, int rows, bool topEdge, bool bottomEdge, int firstRow, int lastRow, const Kernel& kernel) {
+    for (int y = 0; y < rows; y++) {
+        in[y * w + 0] = in[y * w + 1];
+        in[y * w + w - 1] = in[y * w + w - 2];
+    }
+    if (topEdge) copy(in + w, in + 2 * w, in);
+    if (bottomEdge) copy(in + (rows - 2) * w, in + (rows - 1) * w, in + (rows - 1) * w);
+
+    for (int y = firstRow; y < lastRow; y++) {
+        if (y == 0 || y == rows - 1) {
+            copy(in + y * w, in + (y + 1) * w, out + y * w);
+        } else {
+            kernel(out + y * w, in + y * w, traversable + y * w, w);
+            out[y * w + 0] = in[y * w + 0];
+            out[y * w + w - 1] = in[y * w + w - 1];
         }
     }
+}
 
-    swap(weights, temporary_buffer);
+/** Runs a number of propagation steps on the map.
+ * Small maps are processed as a whole. Otherwise the map is split into bands of rows which are processed independently (and possibly in parallel).
+ * Each band runs all the steps on a copy of its rows plus one extra row above and below for every step,
+ * so that the band stays in the cache for all steps. The extra rows shrink by one row for every step.
+ * The result is exactly the same as running the steps on the whole map one by one.
+ */
+template<class T, class Kernel>
+static void propagate(InfluenceMapT<T>& map, const InfluenceMapT<T>& traversable, int steps, ThreadPool* pool, const Kernel& kernel) {
+    int w = map.w;
+    int h = map.h;
+    assert(w >= 2 && h >= 2);
+    assert(traversable.w == w && traversable.h == h);
+    assert(steps >= 1);
+
+    int bandHeight = std::max(64, 8 * steps);
+    // Bands only help a single thread if the weights, the output and the traversable map do not fit in the cache together.
+    // The extra rows that each band has to calculate make them a bit slower otherwise.
+    bool fitsInCache = 3 * map.weights.size() * sizeof(T) <= 1024 * 1024;
+    bool useBands = h >= 2 * bandHeight && (pool != nullptr || (steps > 1 && !fitsInCache));
+
+    vector<T>& out = scratchBuffer<T>(0);
+    out.resize(map.weights.size());
+
+    if (!useBands) {
+        for (int step = 0; step < steps; step++) {
+            propagateStep(map.weights.data(), out.data(), traversable.weights.data(), w, h, true, true, 0, h, kernel);
+            swap(map.weights, out);
+        }
+        return;
+    }
+
+    int bands = (h + bandHeight - 1) / bandHeight;
+    const T* weights = map.weights.data();
+    T* result = out.data();
+    parallelFor(pool, bands, [&](int band) {
+        int y0 = band * bandHeight;
+        int y1 = std::min(h, y0 + bandHeight);
+        // Rows that may influence the band within the given number of steps
+        int t0 = std::max(0, y0 - steps);
+        int t1 = std::min(h, y1 + steps);
+        int rows = t1 - t0;
+
+        vector<T>& tile = scratchBuffer<T>(1);
+        tile.resize(2 * rows * w);
+        T* a = tile.data();
+        T* b = a + rows * w;
+        copy(weights + t0 * w, weights + t1 * w, a);
+        for (int step = 0; step < steps; step++) {
+            // Only the rows which can still influence the band in the remaining steps have to be calculated
+            int remaining = steps - 1 - step;
+            int firstRow = std::max(0, y0 - remaining - t0);
+            int lastRow = std::min(rows, y1 + remaining - t0);
+            propagateStep(a, b, traversable.weights.data() + t0 * w, w, rows, t0 == 0, t1 == h, firstRow, lastRow, kernel);
+            swap(a, b);
+        }
+        copy(a + (y0 - t0) * w, a + (y1 - t0) * w, result + y0 * w);
+    });
+    swap(map.weights, out);
 }
 
-void InfluenceMap::propagateSum(double decay, double speed, const InfluenceMap& traversable) {
-    // double decayCorrectionFactor = (5*(1-decay) + 4*pow(1-decay,1.41))/9;
-    // decay *= decay / (1 - decayCorrectionFactor);
-    double factor = 1 - decay;
-    // cout << "Estimated decay at " << ((5*(1-decay) + 4*pow(1-decay,1.41))/9) << endl;
-    // Diagonal decay
-    // double factor2 = pow(factor, 1.41);
+template<class T>
+void InfluenceMapT<T>::propagateMax(T decay, T speed, const InfluenceMapT& traversable, int steps, ThreadPool* pool) {
+    propagate(*this, traversable, steps, pool, PropagateMaxKernel<T>(decay, speed));
+}
 
-    double gaussianFactor0 = 1;     //0.195346;
-    double gaussianFactor1 = 1;     //0.123317;
-    double gaussianFactor2 = 0.75;  //0.077847;
+template<class T>
+void InfluenceMapT<T>::propagateSum(T decay, T speed, const InfluenceMapT& traversable, int steps, ThreadPool* pool) {
+    propagate(*this, traversable, steps, pool, PropagateSumKernel<T>(decay, speed));
+}
 
-    temporary_buffer.resize(weights.size());
-    vector<double>& newWeights = temporary_buffer;
+/** Relaxes the inner cells of one row using the already relaxed row before it (in the direction of the pass) and the cell before it in the same row.
+ * dy is +1 for the forward pass and -1 for the backward pass. Returns true if any cell was changed significantly.
+ */
+template<class T>
+static bool chamferRow(T* weights, const T* traversable, int w, int y, int dy, T factor, T factor2) {
+    T* row = weights + y * w;
+    const T* traversableRow = traversable + y * w;
+    const T* prev = row - dy * w;
+    bool changed = false;
+    // Paths with the same length may give results that differ in the last few bits because of rounding,
+    // changes that small are ignored when checking for convergence (but the larger value is still used)
+    const T tolerance = 1 + 16 * std::numeric_limits<T>::epsilon();
+
+    // The contributions from the previous row do not depend on each other, so they are calculated in a separate (vectorizable) loop
+    for (int x = 1; x < w - 1; x++) {
+        T v = std::max(std::max(row[x], prev[x] * factor), std::max(prev[x - 1] * factor2, prev[x + 1] * factor2));
+        v = traversableRow[x] == 0 ? 0 : v;
+        changed |= v > row[x] * tolerance;
+        row[x] = v;
+    }
+
+    // Cells in the same row depend on the previous cell, so this has to be done serially in the direction of the pass.
+    // The previous value is kept in a register and the loop is branch free, as the branches would be hard to predict.
+    int start = dy > 0 ? 0 : w - 1;
+    T previous = row[start];
+    for (int k = 1, x = start + dy; k < w - 1; k++, x += dy) {
+        T v = previous * factor;
+        T current = row[x];
+        bool improved = v > current && traversableRow[x] != 0;
+        changed |= improved && v > current * tolerance;
+        previous = improved ? v : current;
+        row[x] = previous;
+    }
+    return changed;
+}
+
+template<class T>
+void InfluenceMapT<T>::propagateMaxUntilConvergence(T decay, const InfluenceMapT& traversable) {
+    assert(traversable.w == w && traversable.h == h);
+    T factor = 1 - decay;
+    // Diagonal decay, same as in propagateMax
+    T factor2 = pow(factor, (T)1.41);
 
-    for (int y = 0; y < h; y++) {
-        weights[y * w + 0] = weights[y * w + 1];
-        weights[y * w + w - 1] = weights[y * w + w - 2];
-    }
-    for (int x = 0; x < w; x++) {
-        weights[x] = weights[x + w];
-        weights[(h - 1) * w + x] = weights[(h - 2) * w + x];
+    for (int i = 0; i < w * h; i++) {
+        if (traversable[i] == 0) weights[i] = 0;
+    }
+
+    // Maps that are only one cell wide or tall have no inner cells at all, so no influence spreads (and propagateMax does not support them)
+    if (w < 2 || h < 2) return;
+
+    if (w < 3 || h < 3) {
+        // All cells are on the border, which propagateMax handles in a way that the passes below cannot reproduce. These maps are tiny anyway.
+        // NaN weights must compare equal to themselves, otherwise the loop would never end.
+        auto same = [](T a, T b) { return a == b || (std::isnan(a) && std::isnan(b)); };
+        while (true) {
+            InfluenceMapT next = *this;
+            next.propagateMax(decay, 1, traversable);
+            next.max(*this);
+            if (std::equal(next.weights.begin(), next.weights.end(), weights.begin(), same)) return;
+            swap(weights, next.weights);
+        }
     }
 
-    for (int y = 1; y < h - 1; y++) {
-        int yw = y * w;
-        for (int x = 1; x < w - 1; x++) {
-            int i = yw + x;
-
-            if (traversable[i] == 0) {
-                newWeights[i] = 0;
-                continue;
-            }
-
-            double neighbours = gaussianFactor0;
-            neighbours += gaussianFactor1 * (traversable[i - 1] + traversable[i + 1] + traversable[i - w] + traversable[i + w]) + gaussianFactor2 * (traversable[i - w - 1] + traversable[i - w + 1] + traversable[i + w - 1] + traversable[i + w + 1]);
-
-            double c = 0;
-            c += weights[i - 1];
-            c += weights[i + 1];
-            c += weights[i - w];
-            c += weights[i + w];
-            c *= gaussianFactor1;
-
-            c += weights[i] * gaussianFactor0;
-
-            double c2 = 0;
-            c2 += weights[i - w - 1];
-            c2 += weights[i - w + 1];
-            c2 += weights[i + w - 1];
-            c2 += weights[i + w + 1];
-            c2 *= gaussianFactor2;
-            c += c2;
-
-            // To prevent the total weight values from increasing unbounded
-            if (neighbours > 0)
-                c /= neighbours;
+    // Same as in propagateMax the cells on the border do not spread any influence of their own, they only mirror the adjacent row or column.
+    // The mirrored values can never improve the inner cells, so the border is cleared while the inner cells are relaxed.
+    InfluenceMapT border = *this;
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x += (y == 0 || y == h - 1) ? 1 : w - 1) weights[y * w + x] = 0;
+    }
 
-            c = c * speed + (1 - speed) * weights[i];
-            newWeights[i] = c * factor;
+    // Alternate forward passes (from the top left corner) and backward passes (from the bottom right corner).
+    // Every shortest path that does not have to go around obstacles has been covered after the first pair of passes,
+    // paths around obstacles may need a few more.
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int y = 1; y < h - 1; y++) {
+            changed |= chamferRow(weights.data(), traversable.weights.data(), w, y, 1, factor, factor2);
+        }
+        for (int y = h - 2; y >= 1; y--) {
+            changed |= chamferRow(weights.data(), traversable.weights.data(), w, y, -1, factor, factor2);
         }
     }
 
-    swap(weights, temporary_buffer);
+    // Each border cell keeps the maximum of its old value and the closest inner cell (the diagonal one for the corners)
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x += (y == 0 || y == h - 1) ? 1 : w - 1) {
+            T mirrored = (*this)(std::min(w - 2, std::max(1, x)), std::min(h - 2, std::max(1, y)));
+            weights[y * w + x] = std::max(border(x, y), mirrored);
+        }
+    }
 }
 
-void InfluenceMap::print() const {
+template<class T>
+void InfluenceMapT<T>::print() const {
     for (int y = 0; y < w; y++) {
         for (int x = 0; x < h; x++) {
             cout << setfill(' ') << setw(6) << setprecision(1) << fixed << weights[y * w + x] << " ";
@@ -448,7 +648,8 @@ static default_random_engine generator(time(0));
  * The probability of picking each cell is proportional to its weight.
  * The map does not have to be normalized.
  */
-Point2DI InfluenceMap::samplePointFromProbabilityDistribution() const {
+template<class T>
+Point2DI InfluenceMapT<T>::samplePointFromProbabilityDistribution() const {
     uniform_real_distribution<double> distribution(0.0, sum());
     double picked = distribution(generator);
 
@@ -461,3 +662,6 @@ Point2DI InfluenceMap::samplePointFromProbabilityDistribution() const {
     // Should in theory not happen, but it may actually happen because of floating point errors
     return Point2DI(w - 1, h - 1);
 }
+
+template struct InfluenceMapT<double>;
+template struct InfluenceMapT<float>;
@@ -1,112 +1,237 @@
 #pragma once
 #include "sc2api/sc2_api.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
 #include <vector>
 
-struct InfluenceMap {
-    std::vector<double> weights;
+struct ThreadPool;
+
+/** A 2D grid of weights stored in row-major order.
+ * The element type is usually double or float, using float halves the memory bandwidth of all operations
+ * which makes a big difference for large maps that are updated many times per frame.
+ * Only InfluenceMapT<double> and InfluenceMapT<float> are instantiated (see influence.cpp).
+ * The element-wise operations are vectorized using the kernels in simd.h.
+ */
+template<class T>
+struct InfluenceMapT {
+    std::vector<T> weights;
     int w, h;
 
-    InfluenceMap() {
+    InfluenceMapT() {
     }
 
-    InfluenceMap(int width, int height) {
+    InfluenceMapT(int width, int height) {
         w = width;
         h = height;
-        weights = std::vector<double>(width*height, 0.0);
+        weights = std::vector<T>(width*height, 0.0);
     }
 
-    InfluenceMap(const sc2::ImageData map);
-    InfluenceMap(const SC2APIProtocol::ImageData map);
+    InfluenceMapT(const sc2::ImageData map);
+    InfluenceMapT(const SC2APIProtocol::ImageData map);
 
-    inline double& operator()(int x, int y) {
+    inline T& operator()(int x, int y) {
         return weights[y*w + x];
     }
 
-    inline double operator()(int x, int y) const {
+    inline T operator()(int x, int y) const {
         return weights[y*w + x];
     }
 
-    inline double& operator()(sc2::Point2DI p) {
+    inline T& operator()(sc2::Point2DI p) {
         return weights[p.y*w + p.x];
     }
 
-    inline double operator()(sc2::Point2DI p) const {
+    inline T operator()(sc2::Point2DI p) const {
         return weights[p.y*w + p.x];
     }
 
-    inline double& operator()(sc2::Point2D p) {
+    inline T& operator()(sc2::Point2D p) {
         return weights[std::min(h-1, std::max(0, (int)round(p.y)))*w + std::min(w-1, std::max(0, (int)round(p.x)))];
     }
 
-    inline double operator()(sc2::Point2D p) const {
+    inline T operator()(sc2::Point2D p) const {
         return weights[std::min(h-1, std::max(0, (int)round(p.y)))*w + std::min(w-1, std::max(0, (int)round(p.x)))];
     }
 
-    inline double& operator[](int index) {
+    inline T& operator[](int index) {
         return weights[index];
     }
 
-    inline double operator[](int index) const {
+    inline T operator[](int index) const {
         return weights[index];
     }
 
-    InfluenceMap& operator+= (const InfluenceMap& other);
+    InfluenceMapT& operator+= (const InfluenceMapT& other);
 
-    InfluenceMap& operator+= (double other);
+    InfluenceMapT& operator+= (T other);
 
-    InfluenceMap operator+ (const InfluenceMap& other) const;
+    InfluenceMapT operator+ (const InfluenceMapT& other) const;
 
-    InfluenceMap& operator-= (const InfluenceMap& other);
+    InfluenceMapT& operator-= (const InfluenceMapT& other);
 
-    InfluenceMap operator- (const InfluenceMap& other) const;
+    InfluenceMapT operator- (const InfluenceMapT& other) const;
 
-    InfluenceMap& operator*= (const InfluenceMap& other);
+    InfluenceMapT& operator*= (const InfluenceMapT& other);
 
-    InfluenceMap operator* (const InfluenceMap& other) const;
+    InfluenceMapT operator* (const InfluenceMapT& other) const;
 
-    InfluenceMap& operator/= (const InfluenceMap& other);
+    InfluenceMapT& operator/= (const InfluenceMapT& other);
 
-    InfluenceMap operator/ (const InfluenceMap& other) const;
+    InfluenceMapT operator/ (const InfluenceMapT& other) const;
 
-    InfluenceMap operator+ (double factor) const;
+    InfluenceMapT operator+ (T factor) const;
 
-    InfluenceMap operator- (double factor) const;
+    InfluenceMapT operator- (T factor) const;
 
-    InfluenceMap operator* (double factor) const;
+    InfluenceMapT operator* (T factor) const;
 
-    void operator*= (double factor);
+    void operator*= (T factor);
 
-    void threshold(double value);
+    /** Sets this map to a*b + c in a single pass, without creating any temporary maps */
+    void setMultiplyAdd(const InfluenceMapT& a, const InfluenceMapT& b, const InfluenceMapT& c);
 
+    /** Same as *this += other * factor, but without creating a temporary map */
+    void addMultiple(const InfluenceMapT& other, T factor);
+
+    /** Same as *this = *this * factor + offset, but in a single pass */
+    void multiplyAdd(T factor, T offset);
+
+    void threshold(T value);
+
+    /** Sum of all weights. Always accumulated in double precision */
     double sum() const;
 
-    double max() const;
-    void max(const InfluenceMap& other);
-    double maxFinite() const;
+    T max() const;
+    void max(const InfluenceMapT& other);
+    T maxFinite() const;
 
     sc2::Point2DI argmax() const;
 
-    InfluenceMap replace_nonzero(double with) const;
-    InfluenceMap replace_nan(double with) const;
-    InfluenceMap replace(double value, double with) const;
+    InfluenceMapT replace_nonzero(T with) const;
+    InfluenceMapT replace_nan(T with) const;
+    InfluenceMapT replace(T value, T with) const;
 
-    void addInfluence(double influence, sc2::Point2DI pos);
-    void addInfluence(double influence, sc2::Point2D pos);
-    void setInfluence(double influence, sc2::Point2D pos);
-    void addInfluenceInDecayingCircle(double influence, double radius, sc2::Point2D pos);
-    void setInfluenceInCircle(double influence, double radius, sc2::Point2D pos);
+    void addInfluence(T influence, sc2::Point2DI pos);
+    void addInfluence(T influence, sc2::Point2D pos);
+    void setInfluence(T influence, sc2::Point2D pos);
+    void addInfluenceInDecayingCircle(T influence, T radius, sc2::Point2D pos);
+    void setInfluenceInCircle(T influence, T radius, sc2::Point2D pos);
 
     void addInfluence(const std::vector<std::vector<double> >& influence, sc2::Point2D);
-    
+
     void addInfluenceMultiple(const std::vector<std::vector<double> >& influence, sc2::Point2D, double factor);
 
     void maxInfluence(const std::vector<std::vector<double> >& influence, sc2::Point2D);
 
     void maxInfluenceMultiple(const std::vector<std::vector<double> >& influence, sc2::Point2D, double factor);
 
-    void propagateMax(double decay, double speed, const InfluenceMap& traversable);
-    void propagateSum(double decay, double speed, const InfluenceMap& traversable);
+    /** Spreads the influence to neighbouring cells by taking the maximum of the neighbours, decaying with the distance.
+     * Cells that are not traversable (zero in the traversable map) are set to zero.
+     * Runs the given number of steps. For maps that do not fit in the cache this is faster than calling the function several times, because the map is processed in cache friendly bands.
+     * If a thread pool is given, large maps are processed in parallel. The result is the same regardless of the number of threads.
+     * Safe to call on different maps from several threads at the same time.
+     */
+    void propagateMax(T decay, T speed, const InfluenceMapT& traversable, int steps = 1, ThreadPool* pool = nullptr);
+
+    /** Spreads the influence as far as it goes, using a chamfer distance transform.
+     * The result is weights[j] * (1-decay)^d maximized over all cells j, where d is the distance from j through traversable cells,
+     * with the same weights as #propagateMax (1 for adjacent cells and 1.41 for diagonal cells).
+     * The border is handled like in #propagateMax: influence does not spread from or along the outermost ring of cells,
+     * each of those cells ends up with the maximum of its own weight and the weight of the closest inner cell.
+     * On maps that are only one cell wide or tall nothing spreads.
+     * Cells that are not traversable are set to zero first.
+     * With that, this is what repeatedly calling #propagateMax with a speed of 1 and keeping the maximum of the old and new weights converges to,
+     * but each pass over the map costs about the same as a single #propagateMax step no matter how far the influence spreads.
+     * A few passes are needed if the influence has to go around obstacles. Weights are assumed to be non-negative.
+     */
+    void propagateMaxUntilConvergence(T decay, const InfluenceMapT& traversable);
+
+    /** Spreads the influence to neighbouring cells by blurring it. Same parameters as #propagateMax */
+    void propagateSum(T decay, T speed, const InfluenceMapT& traversable, int steps = 1, ThreadPool* pool = nullptr);
     sc2::Point2DI samplePointFromProbabilityDistribution() const;
 
     void print() const;
 };
+
+/** Double precision influence map. This was the only kind of influence map before the element type became a template parameter */
+typedef InfluenceMapT<double> InfluenceMap;
+typedef InfluenceMapT<float> InfluenceMapF;
+
+/** Converts an influence map to a different element type */
+template<class U, class T>
+InfluenceMapT<U> convertInfluenceMap(const InfluenceMapT<T>& map) {
+    InfluenceMapT<U> result;
+    result.w = map.w;
+    result.h = map.h;
+    result.weights.assign(map.weights.begin(), map.weights.end());
+    return result;
+}
+
+/** Compact storage for an influence map using 8 or 16 bit integers.
+ * A value is stored as a code such that value = offset + code * scale.
+ * The largest code is reserved for infinity so that cost maps with impassable cells survive the round trip.
+ * NaN and negative infinity are stored as the smallest value.
+ *
+ * This is intended for keeping many maps in memory or sending them elsewhere,
+ * the maps have to be converted to InfluenceMapT<float> or InfluenceMapT<double> to do any calculations with them.
+ */
+template<class Q>
+struct QuantizedInfluenceMap {
+    static_assert(std::is_unsigned<Q>::value && std::is_integral<Q>::value, "Quantized influence maps must use unsigned integers");
+    static const Q InfinityCode = std::numeric_limits<Q>::max();
+
+    std::vector<Q> weights;
+    int w = 0, h = 0;
+    float offset = 0;
+    float scale = 1;
+
+    QuantizedInfluenceMap() {}
+
+    /** Quantizes the map using the range between the smallest and largest finite values in the map */
+    template<class T>
+    explicit QuantizedInfluenceMap(const InfluenceMapT<T>& map) : weights(map.weights.size()), w(map.w), h(map.h) {
+        T mn = std::numeric_limits<T>::infinity();
+        T mx = -std::numeric_limits<T>::infinity();
+        for (T v : map.weights) {
+            if (std::isfinite(v)) {
+                mn = std::min(mn, v);
+                mx = std::max(mx, v);
+            }
+        }
+        if (mn > mx) mn = mx = 0;
+
+        offset = mn;
+        // The largest code is reserved for infinity
+        scale = mx > mn ? (mx - mn) / (InfinityCode - 1) : 1;
+        float invScale = 1 / scale;
+        for (size_t i = 0; i < weights.size(); i++) {
+            T v = map.weights[i];
+            if (std::isinf(v) && v > 0) weights[i] = InfinityCode;
+            else if (!std::isfinite(v)) weights[i] = 0;
+            else weights[i] = (Q)std::min((float)(InfinityCode - 1), (float)std::round((v - mn) * invScale));
+        }
+    }
+
+    inline float operator()(int x, int y) const {
+        return (*this)[y*w + x];
+    }
+
+    inline float operator[](int index) const {
+        Q code = weights[index];
+        return code == InfinityCode ? std::numeric_limits<float>::infinity() : offset + code * scale;
+    }
+
+    /** Converts the quantized map back to a regular influence map */
+    template<class T>
+    InfluenceMapT<T> dequantize() const {
+        InfluenceMapT<T> result(w, h);
+        for (size_t i = 0; i < weights.size(); i++) result.weights[i] = (*this)[i];
+        return result;
+    }
+};
+
+typedef QuantizedInfluenceMap<uint8_t> InfluenceMapU8;
+typedef QuantizedInfluenceMap<uint16_t> InfluenceMapU16;
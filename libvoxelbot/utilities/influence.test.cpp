@@ -0,0 +1,284 @@
+#include <libvoxelbot/utilities/influence.h>
+#include <libvoxelbot/utilities/thread_pool.h>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+using namespace std;
+using namespace sc2;
+
+template <class T>
+static InfluenceMapT<T> randomMap(int w, int h, default_random_engine& rnd) {
+    uniform_real_distribution<T> dist(0, 10);
+    InfluenceMapT<T> map(w, h);
+    for (auto& v : map.weights) v = dist(rnd);
+    return map;
+}
+
+template <class T>
+static InfluenceMapT<T> randomTraversable(int w, int h, default_random_engine& rnd) {
+    InfluenceMapT<T> traversable(w, h);
+    for (auto& v : traversable.weights) v = rnd() % 5 == 0 ? 0 : 1;
+    return traversable;
+}
+
+template <class T>
+static bool sameWeights(const InfluenceMapT<T>& a, const InfluenceMapT<T>& b) {
+    if (a.w != b.w || a.h != b.h) return false;
+    for (size_t i = 0; i < a.weights.size(); i++) {
+        bool bothNan = isnan(a.weights[i]) && isnan(b.weights[i]);
+        if (!bothNan && a.weights[i] != b.weights[i]) return false;
+    }
+    return true;
+}
+
+/** The vectorized operations must give exactly the same results as plain loops, also for the elements after the last full SIMD register */
+template <class T>
+static void testElementwise(int w, int h, default_random_engine& rnd) {
+    InfluenceMapT<T> a = randomMap<T>(w, h, rnd);
+    InfluenceMapT<T> b = randomMap<T>(w, h, rnd);
+    InfluenceMapT<T> c = randomMap<T>(w, h, rnd);
+    for (auto& v : b.weights) v += 1;
+    int n = w * h;
+
+    auto expect = [&](const InfluenceMapT<T>& result, auto fn) {
+        assert(result.w == w && result.h == h);
+        for (int i = 0; i < n; i++) {
+            T expected = fn(i);
+            assert(result.weights[i] == expected || (isnan(result.weights[i]) && isnan(expected)));
+        }
+    };
+
+    expect(a + b, [&](int i) { return a[i] + b[i]; });
+    expect(a - b, [&](int i) { return a[i] - b[i]; });
+    expect(a * b, [&](int i) { return a[i] * b[i]; });
+    expect(a / b, [&](int i) { return a[i] / b[i]; });
+    expect(a + (T)2, [&](int i) { return a[i] + (T)2; });
+    expect(a * (T)3, [&](int i) { return a[i] * (T)3; });
+
+    InfluenceMapT<T> result;
+    result.setMultiplyAdd(a, b, c);
+    expect(result, [&](int i) { return a[i] * b[i] + c[i]; });
+
+    result = a;
+    result.addMultiple(b, 0.5);
+    expect(result, [&](int i) { return a[i] + b[i] * (T)0.5; });
+
+    result = a;
+    result.multiplyAdd(2, 1);
+    expect(result, [&](int i) { return a[i] * (T)2 + (T)1; });
+
+    result = a;
+    result.threshold(5);
+    expect(result, [&](int i) { return a[i] >= 5 ? (T)1 : (T)0; });
+
+    double expectedSum = 0;
+    for (int i = 0; i < n; i++) expectedSum += a[i];
+    assert(abs(a.sum() - expectedSum) <= 1e-5 * expectedSum);
+
+    // NaN and infinity handling
+    InfluenceMapT<T> special = a;
+    special.weights[n / 2] = numeric_limits<T>::quiet_NaN();
+    special.weights[n - 1] = numeric_limits<T>::quiet_NaN();
+    special.weights[n / 3] = numeric_limits<T>::infinity();
+    special.weights[0] = -numeric_limits<T>::infinity();
+
+    T expectedMax = 0;
+    T expectedMaxFinite = 0;
+    for (int i = 0; i < n; i++) {
+        if (special[i] > expectedMax) expectedMax = special[i];
+        if (isfinite(special[i]) && special[i] > expectedMaxFinite) expectedMaxFinite = special[i];
+    }
+    assert(special.max() == numeric_limits<T>::infinity());
+    assert(special.max() == expectedMax);
+    assert(special.maxFinite() == expectedMaxFinite);
+
+    // The first cell with the largest finite value
+    int expectedArgmax = -1;
+    for (int i = 0; i < n; i++) {
+        if (isfinite(special[i]) && (expectedArgmax == -1 || special[i] > special[expectedArgmax])) expectedArgmax = i;
+    }
+    auto argmax = special.argmax();
+    assert(argmax.x == expectedArgmax % w && argmax.y == expectedArgmax / w);
+
+    expect(special.replace_nan(-1), [&](int i) { return isnan(special[i]) ? (T)-1 : special[i]; });
+
+    // Same as std::max(a, b)
+    result = special;
+    result.max(b);
+    expect(result, [&](int i) { return std::max(special[i], b[i]); });
+    result = b;
+    result.max(special);
+    expect(result, [&](int i) { return std::max(b[i], special[i]); });
+}
+
+/** Running several steps at once (in bands, and possibly in parallel) must give exactly the same result as running the steps one by one */
+template <class T>
+static void testPropagation(int w, int h, int steps, ThreadPool& pool, default_random_engine& rnd) {
+    InfluenceMapT<T> initial = randomMap<T>(w, h, rnd);
+    InfluenceMapT<T> traversable = randomTraversable<T>(w, h, rnd);
+
+    for (T speed : { (T)1, (T)0.6 }) {
+        InfluenceMapT<T> expectedMax = initial;
+        InfluenceMapT<T> expectedSum = initial;
+        for (int i = 0; i < steps; i++) {
+            expectedMax.propagateMax(0.1, speed, traversable);
+            expectedSum.propagateSum(0.1, speed, traversable);
+        }
+
+        for (ThreadPool* p : { (ThreadPool*)nullptr, &pool }) {
+            InfluenceMapT<T> resultMax = initial;
+            resultMax.propagateMax(0.1, speed, traversable, steps, p);
+            assert(sameWeights(resultMax, expectedMax));
+
+            InfluenceMapT<T> resultSum = initial;
+            resultSum.propagateSum(0.1, speed, traversable, steps, p);
+            assert(sameWeights(resultSum, expectedSum));
+        }
+    }
+}
+
+/** Must give the same result as iterating propagateMax (with a speed of 1 and keeping the maximum of the old and new weights) until nothing changes */
+template <class T>
+static void testPropagationUntilConvergence(InfluenceMapT<T> initial, const InfluenceMapT<T>& traversable) {
+    for (size_t i = 0; i < initial.weights.size(); i++) {
+        if (traversable.weights[i] == 0) initial.weights[i] = 0;
+    }
+
+    InfluenceMapT<T> expected = initial;
+    while (true) {
+        InfluenceMapT<T> next = expected;
+        next.propagateMax(0.1, 1, traversable);
+        next.max(expected);
+        if (sameWeights(next, expected)) break;
+        expected = next;
+    }
+
+    InfluenceMapT<T> result = initial;
+    result.propagateMaxUntilConvergence(0.1, traversable);
+    T tolerance = 100 * numeric_limits<T>::epsilon();
+    for (size_t i = 0; i < expected.weights.size(); i++) {
+        assert(abs(result.weights[i] - expected.weights[i]) <= tolerance * std::max((T)1, expected.weights[i]));
+    }
+}
+
+template <class T>
+static void testQuantization(default_random_engine& rnd) {
+    InfluenceMapT<T> map = randomMap<T>(31, 17, rnd);
+    for (auto& v : map.weights) v -= 3;
+    map.weights[5] = numeric_limits<T>::infinity();
+    map.weights[6] = numeric_limits<T>::quiet_NaN();
+    map.weights[7] = -numeric_limits<T>::infinity();
+
+    T mn = numeric_limits<T>::infinity();
+    T mx = -numeric_limits<T>::infinity();
+    for (T v : map.weights) {
+        if (isfinite(v)) {
+            mn = min(mn, v);
+            mx = max(mx, v);
+        }
+    }
+
+    InfluenceMapU8 q8(map);
+    InfluenceMapU16 q16(map);
+    auto d8 = q8.dequantize<T>();
+    auto d16 = q16.dequantize<T>();
+    assert(d8.w == map.w && d8.h == map.h);
+    assert(d16.w == map.w && d16.h == map.h);
+    for (size_t i = 0; i < map.weights.size(); i++) {
+        T v = map.weights[i];
+        if (isinf(v) && v > 0) {
+            assert(isinf(d8[i]) && d8[i] > 0);
+            assert(isinf(d16[i]) && d16[i] > 0);
+        } else if (!isfinite(v)) {
+            // NaN and negative infinity are stored as the smallest value
+            assert(abs(d8[i] - mn) < 1e-4);
+            assert(abs(d16[i] - mn) < 1e-4);
+        } else {
+            // Rounded to the closest code
+            assert(abs(d8[i] - v) <= q8.scale * 0.5 + 1e-4);
+            assert(abs(d16[i] - v) <= q16.scale * 0.5 + 1e-4);
+            assert(q8(i % map.w, i / map.w) == d8[i]);
+        }
+    }
+
+    // Maps where all values are the same
+    InfluenceMapT<T> constant(4, 3);
+    for (auto& v : constant.weights) v = 2;
+    auto roundTrip = InfluenceMapU8(constant).dequantize<T>();
+    for (T v : roundTrip.weights) assert(v == 2);
+}
+
+int main() {
+    default_random_engine rnd(123);
+    ThreadPool pool(4);
+
+    {
+        // Converting between element types
+        InfluenceMap map = randomMap<double>(13, 7, rnd);
+        InfluenceMapF mapF = convertInfluenceMap<float>(map);
+        InfluenceMap back = convertInfluenceMap<double>(mapF);
+        assert(mapF.w == map.w && mapF.h == map.h);
+        for (size_t i = 0; i < map.weights.size(); i++) {
+            assert(mapF.weights[i] == (float)map.weights[i]);
+            assert(abs(back.weights[i] - map.weights[i]) < 1e-5);
+        }
+    }
+
+    for (int w : { 1, 7, 33, 301 }) {
+        testElementwise<float>(w, 5, rnd);
+        testElementwise<double>(w, 5, rnd);
+    }
+
+    // Odd widths, and heights large enough that the map is split into bands (the band height is max(64, 8*steps)).
+    // The largest map does not fit in the cache, which makes even a single thread use bands.
+    testPropagation<float>(17, 13, 3, pool, rnd);
+    for (int steps : { 1, 3, 9 }) {
+        testPropagation<float>(301, 203, steps, pool, rnd);
+        testPropagation<double>(301, 203, steps, pool, rnd);
+    }
+    testPropagation<float>(513, 401, 5, pool, rnd);
+    testPropagation<double>(257, 150, 9, pool, rnd);
+
+    for (auto size : { make_pair(2, 2), make_pair(3, 7), make_pair(40, 31), make_pair(71, 64) }) {
+        int w = size.first;
+        int h = size.second;
+        // A few sources, some of them on the border
+        InfluenceMap sources(w, h);
+        for (int i = 0; i < 6; i++) sources(rnd() % w, rnd() % h) = 1 + rnd() % 10;
+        sources(0, h / 2) = 5;
+        InfluenceMap traversable = randomTraversable<double>(w, h, rnd);
+        testPropagationUntilConvergence<double>(sources, traversable);
+        testPropagationUntilConvergence<float>(convertInfluenceMap<float>(sources), convertInfluenceMap<float>(traversable));
+
+        // Walls that can only be passed along the border, which the influence must not do
+        if (w >= 5) {
+            for (int y = 0; y < h; y++) traversable(w / 2, y) = y == 0 ? 1 : 0;
+            testPropagationUntilConvergence<double>(sources, traversable);
+        }
+    }
+
+    for (auto size : { make_pair(1, 1), make_pair(1, 9), make_pair(9, 1) }) {
+        // Nothing spreads on maps without inner cells, except that cells that are not traversable are cleared
+        InfluenceMap sources = randomMap<double>(size.first, size.second, rnd);
+        InfluenceMap traversable = randomTraversable<double>(size.first, size.second, rnd);
+        InfluenceMap result = sources;
+        result.propagateMaxUntilConvergence(0.1, traversable);
+        for (size_t i = 0; i < sources.weights.size(); i++) assert(result.weights[i] == (traversable.weights[i] == 0 ? 0 : sources.weights[i]));
+    }
+
+    for (auto size : { make_pair(2, 2), make_pair(2, 6) }) {
+        // NaN weights must not prevent convergence on small maps
+        InfluenceMap sources = randomMap<double>(size.first, size.second, rnd);
+        sources.weights[1] = numeric_limits<double>::quiet_NaN();
+        InfluenceMap traversable(size.first, size.second);
+        for (auto& v : traversable.weights) v = 1;
+        sources.propagateMaxUntilConvergence(0.1, traversable);
+    }
+
+    testQuantization<float>(rnd);
+    testQuantization<double>(rnd);
+
+    cout << "Influence map tests passed" << endl;
+    return 0;
+}
@@ -8,6 +8,7 @@
 #include "sc2api/sc2_map_info.h"
 #include <libvoxelbot/utilities/stdutils.h>
 #include <libvoxelbot/utilities/unit_data_caching.h>
+#include <libvoxelbot/common/unit_lists.h>
 
 using namespace std;
 using namespace sc2;
@@ -333,6 +334,8 @@ void init() {
     unit_type_initial_health[(int)UNIT_TYPEID::TERRAN_FACTORYREACTOR] = {50, 0};
     unit_type_initial_health[(int)UNIT_TYPEID::TERRAN_STARPORTTECHLAB] = {50, 0};
     unit_type_initial_health[(int)UNIT_TYPEID::TERRAN_STARPORTREACTOR] = {50, 0};
+
+    initAvailableUnitTypesTechTables();
 }
 
 
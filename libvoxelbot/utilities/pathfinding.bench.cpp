@@ -0,0 +1,222 @@
+/** Benchmarks for point to point pathfinding.
+ *
+ * Runs random queries on a pathing grid using each of the pathfinding algorithms and prints one JSON object per line with the results.
+ * By default a synthetic 200x176 grid with plateaus, ramps and narrow chokes is used, roughly like a ladder map.
+ * A real pathing grid can be used by passing --grid <file>, where the file contains one line per row of the map
+ * and each character is either '.' or '1' for pathable cells, anything else is unpathable.
+ * Pass --quick to run fewer queries (useful to check that everything works).
+ */
+#include <libvoxelbot/utilities/pathfinding.h>
+#include <libvoxelbot/utilities/profiler.h>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+
+using namespace std;
+using namespace sc2;
+
+// Prevents the compiler from optimizing away the results
+static volatile size_t sink;
+
+static InfluenceMap syntheticPathingGrid(default_random_engine& rnd) {
+    int w = 200;
+    int h = 176;
+    InfluenceMap pathable(w, h);
+    for (int y = 8; y < h - 8; y++) {
+        for (int x = 8; x < w - 8; x++) pathable(x, y) = 1;
+    }
+
+    // Cliffs that split the map into plateaus, with a few ramps through them
+    for (int i = 0; i < 12; i++) {
+        bool horizontal = i % 2 == 0;
+        int pos = 20 + rnd() % (horizontal ? h - 40 : w - 40);
+        int start = rnd() % (horizontal ? w : h) / 2;
+        int length = 40 + rnd() % 80;
+        for (int k = start; k < min(start + length, horizontal ? w : h); k++) {
+            for (int t = 0; t < 3; t++) {
+                if (horizontal) pathable(k, pos + t) = 0;
+                else pathable(pos + t, k) = 0;
+            }
+        }
+        int ramp = start + rnd() % length;
+        for (int k = ramp; k < ramp + 4; k++) {
+            for (int t = 0; t < 3; t++) {
+                if (horizontal && k < w) pathable(k, pos + t) = 1;
+                if (!horizontal && k < h) pathable(pos + t, k) = 1;
+            }
+        }
+    }
+
+    // Rocks and other small obstacles
+    for (int i = 0; i < 40; i++) {
+        int cx = rnd() % w;
+        int cy = rnd() % h;
+        int r = 1 + rnd() % 3;
+        for (int y = max(0, cy - r); y <= min(h - 1, cy + r); y++) {
+            for (int x = max(0, cx - r); x <= min(w - 1, cx + r); x++) pathable(x, y) = 0;
+        }
+    }
+    return pathable;
+}
+
+static InfluenceMap loadPathingGrid(const string& path) {
+    ifstream file(path);
+    if (!file) {
+        cerr << "Could not open " << path << endl;
+        exit(1);
+    }
+
+    vector<string> lines;
+    string line;
+    while (getline(file, line)) {
+        if (!line.empty()) lines.push_back(line);
+    }
+
+    int h = lines.size();
+    int w = 0;
+    for (auto& l : lines) w = max(w, (int)l.size());
+    InfluenceMap pathable(w, h);
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < (int)lines[y].size(); x++) pathable(x, y) = lines[y][x] == '.' || lines[y][x] == '1';
+    }
+    return pathable;
+}
+
+static void report(const string& benchmark, const string& costs, int queries, double millis) {
+    cout << "{"
+        << "\"benchmark\": \"" << benchmark << "\", "
+        << "\"costs\": \"" << costs << "\", "
+        << "\"queries\": " << queries << ", "
+        << "\"us_per_query\": " << (1000.0 * millis / queries)
+        << "}" << endl;
+}
+
+static void runBenchmarks(const string& name, const InfluenceMap& costs, int queries, default_random_engine& rnd) {
+    // Pick random pairs of pathable points
+    vector<pair<Point2DI, Point2DI>> endpoints;
+    while ((int)endpoints.size() < queries) {
+        Point2DI from(rnd() % costs.w, rnd() % costs.h);
+        Point2DI to(rnd() % costs.w, rnd() % costs.h);
+        if (isfinite(costs(from)) && isfinite(costs(to))) endpoints.push_back(make_pair(from, to));
+    }
+
+    vector<pair<string, PathfindingAlgorithm>> algorithms = {
+        { "dijkstra", PathfindingAlgorithm::Dijkstra },
+        { "astar", PathfindingAlgorithm::AStar },
+        { "astar_buckets", PathfindingAlgorithm::AStarBuckets },
+    };
+    if (name == "uniform") algorithms.push_back({ "jump_point_search", PathfindingAlgorithm::JumpPointSearch });
+
+    // The map does not change between the queries, so it only has to be scanned once
+    PathfindingCostInfo costInfo(costs);
+    for (auto& algorithm : algorithms) {
+        // Warm up caches
+        getPath(endpoints[0].first, endpoints[0].second, costs, costInfo, algorithm.second);
+
+        Stopwatch watch;
+        size_t totalLength = 0;
+        for (auto& e : endpoints) totalLength += getPath(e.first, e.second, costs, costInfo, algorithm.second).size();
+        watch.stop();
+        sink = totalLength;
+        report(algorithm.first, name, queries, watch.millis());
+    }
+
+    {
+        // Paths from a squad to many targets, and from many units to one target
+        vector<Point2DI> targets;
+        for (int i = 0; i < 32; i++) targets.push_back(endpoints[i % endpoints.size()].second);
+        Point2DI center = endpoints[0].first;
+        int batches = max(1, queries / 32);
+
+        Stopwatch separateWatch;
+        size_t totalLength = 0;
+        for (int k = 0; k < batches; k++) {
+            for (auto t : targets) totalLength += getPath(center, t, costs, PathfindingAlgorithm::Dijkstra).size();
+        }
+        separateWatch.stop();
+        report("separate_32_targets", name, batches, separateWatch.millis());
+
+        Stopwatch batchWatch;
+        for (int k = 0; k < batches; k++) totalLength += getPaths(center, targets, costs).size();
+        batchWatch.stop();
+        report("get_paths_32_targets", name, batches, batchWatch.millis());
+
+        Stopwatch reverseWatch;
+        for (int k = 0; k < batches; k++) totalLength += getPathsToTarget(targets, center, costs).size();
+        reverseWatch.stop();
+        report("get_paths_to_target_32_sources", name, batches, reverseWatch.millis());
+        sink = totalLength;
+    }
+
+    {
+        Stopwatch buildWatch;
+        HierarchicalPathfinder hierarchical(costs);
+        hierarchical.update();
+        buildWatch.stop();
+        report("hierarchical_build", name, 1, buildWatch.millis());
+
+        Stopwatch watch;
+        size_t totalLength = 0;
+        for (auto& e : endpoints) totalLength += hierarchical.getPath(e.first, e.second).size();
+        watch.stop();
+        sink = totalLength;
+        report("hierarchical", name, queries, watch.millis());
+    }
+}
+
+int main(int argc, char** argv) {
+    bool quick = false;
+    string gridPath;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quick") == 0) quick = true;
+        else if (strcmp(argv[i], "--grid") == 0 && i + 1 < argc) gridPath = argv[++i];
+    }
+
+    default_random_engine rnd(1234);
+    InfluenceMap pathable = gridPath.empty() ? syntheticPathingGrid(rnd) : loadPathingGrid(gridPath);
+    int queries = quick ? 20 : 500;
+
+    // Uniform costs
+    InfluenceMap uniform(pathable.w, pathable.h);
+    for (size_t i = 0; i < pathable.weights.size(); i++) uniform.weights[i] = pathable.weights[i] != 0 ? 1 : numeric_limits<double>::infinity();
+    runBenchmarks("uniform", uniform, queries, rnd);
+
+    // Costs with a few areas to avoid, like when pathing around enemy units
+    InfluenceMap danger(uniform.w, uniform.h);
+    for (int i = 0; i < 10; i++) danger.addInfluenceInDecayingCircle(20, 12, Point2D(rnd() % danger.w, rnd() % danger.h));
+    danger += uniform;
+    runBenchmarks("danger", danger, queries, rnd);
+
+    // Distance fields from a few bases, while buildings are placed and destroyed
+    InfluenceMap startingPoints(uniform.w, uniform.h);
+    for (int i = 0; i < 8; i++) startingPoints(rnd() % uniform.w, rnd() % uniform.h) = 1;
+    int updates = quick ? 20 : 500;
+    {
+        Stopwatch watch;
+        for (int i = 0; i < updates; i++) sink = getDistances(startingPoints, uniform).weights.size();
+        watch.stop();
+        report("get_distances", "uniform", updates, watch.millis());
+    }
+    {
+        DistanceField field(startingPoints, uniform);
+        field.update();
+        Stopwatch watch;
+        // Each update destroys the previous 3x3 building and places a new one
+        for (int i = 0; i < updates; i++) {
+            InfluenceMap withBuilding = uniform;
+            int bx = 1 + rnd() % (uniform.w - 2);
+            int by = 1 + rnd() % (uniform.h - 2);
+            for (int y = by - 1; y <= by + 1; y++) {
+                for (int x = bx - 1; x <= bx + 1; x++) withBuilding(x, y) = numeric_limits<double>::infinity();
+            }
+            field.setCosts(withBuilding);
+            sink = field.getDistances().weights.size();
+        }
+        watch.stop();
+        report("distance_field_update", "uniform", updates, watch.millis());
+    }
+
+    return 0;
+}
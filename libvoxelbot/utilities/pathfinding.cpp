@@ -1,42 +1,115 @@
 #include <libvoxelbot/utilities/pathfinding.h>
+#include <algorithm>
 #include <cmath>
 #include <iostream>
-#include <queue>
 #include <vector>
 
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 using namespace std;
 using namespace sc2;
 
-struct PathfindingEntry {
-    double cost;
-    double h;
-    Point2DI pos;
+static const int dx[8] = { 1, 1, 1, 0, 0, -1, -1, -1 };
+static const int dy[8] = { 1, 0, -1, 1, -1, 1, 0, -1 };
+static const double dc[8] = { 1.41, 1, 1.41, 1, 1, 1.41, 1, 1.41 };
 
-    PathfindingEntry(double _cost, Point2DI _pos)
-        : cost(_cost), h(0), pos(_pos) {
+void PathfindingContext::begin(int w, int h) {
+    size_t size = w * h;
+    if (generation.size() < size) {
+        cost.resize(size);
+        parent.resize(size);
+        generation.resize(size, 0);
+        targetGeneration.resize(size, 0);
     }
+    queue.clear();
 
-    PathfindingEntry(double _cost, double _h, Point2DI _pos)
-        : cost(_cost), h(_h), pos(_pos) {
+    currentGeneration++;
+    if (currentGeneration == 0) {
+        // The generation counter wrapped around, old stamps could be mistaken for new ones
+        fill(generation.begin(), generation.end(), 0);
+        fill(targetGeneration.begin(), targetGeneration.end(), 0);
+        currentGeneration = 1;
     }
+}
+
+PathfindingContext& PathfindingContext::threadLocal() {
+    static thread_local PathfindingContext context;
+    return context;
+}
+
+void PathfindingRadixQueue::clear() {
+    for (auto& bucket : buckets) bucket.clear();
+    last = 0;
+    count = 0;
+}
 
-    bool operator<(const PathfindingEntry& other) const {
-        return cost + h > other.cost + other.h;
+/** Index of the highest set bit plus one, or zero if no bits are set */
+static inline int bitLength(uint32_t v) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    return _BitScanReverse(&index, v) ? (int)index + 1 : 0;
+#elif defined(__GNUC__) || defined(__clang__)
+    return v == 0 ? 0 : 32 - __builtin_clz(v);
+#else
+    int length = 0;
+    while (v != 0) {
+        v >>= 1;
+        length++;
     }
-};
+    return length;
+#endif
+}
 
-const int MAX_MAP_SIZE = 256;
+static inline int radixBucket(uint32_t key, uint32_t last) {
+    return bitLength(key ^ last);
+}
 
-int dx[8] = { 1, 1, 1, 0, 0, -1, -1, -1 };
-int dy[8] = { 1, 0, -1, 1, -1, 1, 0, -1 };
-double dc[8] = { 1.41, 1, 1.41, 1, 1, 1.41, 1, 1.41 };
+void PathfindingRadixQueue::push(uint32_t key, const PathfindingEntry& entry) {
+    assert(key >= last);
+    buckets[radixBucket(key, last)].push_back(make_pair(key, entry));
+    count++;
+}
+
+PathfindingEntry PathfindingRadixQueue::pop() {
+    assert(count > 0);
+    if (buckets[0].empty()) {
+        // Find the first non-empty bucket and redistribute its entries relative to the smallest key in it.
+        // All of them will end up in lower buckets.
+        int i = 1;
+        while (buckets[i].empty()) i++;
+        uint32_t newLast = buckets[i][0].first;
+        for (auto& item : buckets[i]) newLast = min(newLast, item.first);
+        last = newLast;
+        for (auto& item : buckets[i]) buckets[radixBucket(item.first, last)].push_back(item);
+        buckets[i].clear();
+    }
+
+    auto entry = buckets[0].back().second;
+    buckets[0].pop_back();
+    count--;
+    return entry;
+}
+
+static inline void pushEntry(vector<PathfindingEntry>& queue, const PathfindingEntry& entry) {
+    queue.push_back(entry);
+    push_heap(queue.begin(), queue.end());
+}
+
+static inline PathfindingEntry popEntry(vector<PathfindingEntry>& queue) {
+    pop_heap(queue.begin(), queue.end());
+    auto entry = queue.back();
+    queue.pop_back();
+    return entry;
+}
 
 /** Returns a map of distances from the starting points.
  * A point is considered a starting point if the element in the startingPoints map is non-zero.
  * The costs per cell are given by the costs map.
  * Diagonal movement costs sqrt(2) times more than axis aligned movement.
  */
-InfluenceMap getDistances(const InfluenceMap& startingPoints, const InfluenceMap& costs) {
+InfluenceMap getDistances(const InfluenceMap& startingPoints, const InfluenceMap& costs, PathfindingContext& context) {
     assert(startingPoints.w == costs.w);
     assert(startingPoints.h == costs.h);
 
@@ -44,119 +117,959 @@ InfluenceMap getDistances(const InfluenceMap& startingPoints, const InfluenceMap
     for (auto& w : distances.weights)
         w = numeric_limits<double>::infinity();
 
-    static priority_queue<PathfindingEntry> pq;
-
     int h = startingPoints.h;
     int w = startingPoints.w;
 
-    for (int y = 0; y < h; y++) {
-        for (int x = 0; x < w; x++) {
-            if (startingPoints(x, y)) {
-                pq.push(PathfindingEntry(0.0, Point2DI(x, y)));
-                distances(x, y) = 0;
-            }
+    // Only the queue is used, the distances are written directly to the result
+    auto& pq = context.queue;
+    pq.clear();
+
+    for (int i = 0; i < w * h; i++) {
+        if (startingPoints.weights[i]) {
+            pq.push_back(PathfindingEntry(0.0, i));
+            distances.weights[i] = 0;
         }
     }
+    make_heap(pq.begin(), pq.end());
 
     while (!pq.empty()) {
-        auto currentEntry = pq.top();
-        auto currentPos = currentEntry.pos;
-        pq.pop();
-        if (currentEntry.cost > distances(currentPos)) {
+        auto currentEntry = popEntry(pq);
+        if (currentEntry.cost > distances.weights[currentEntry.index]) {
             continue;
         }
 
+        int cx = currentEntry.index % w;
+        int cy = currentEntry.index / w;
         for (int i = 0; i < 8; i++) {
-            int x = currentPos.x + dx[i];
-            int y = currentPos.y + dy[i];
-            if ((unsigned int)x >= w || (unsigned int)y >= h || isinf(costs(x, y))) {
+            int x = cx + dx[i];
+            int y = cy + dy[i];
+            if ((unsigned int)x >= (unsigned int)w || (unsigned int)y >= (unsigned int)h) {
                 continue;
             }
 
-            double newDistance = currentEntry.cost + costs(x, y) * dc[i];
-            if (newDistance < distances(x, y)) {
-                distances(x, y) = newDistance;
-                pq.push(PathfindingEntry(newDistance, Point2DI(x, y)));
+            int index = y*w + x;
+            double cellCost = costs.weights[index];
+            if (isinf(cellCost)) continue;
+
+            double newDistance = currentEntry.cost + cellCost * dc[i];
+            if (newDistance < distances.weights[index]) {
+                distances.weights[index] = newDistance;
+                pushEntry(pq, PathfindingEntry(newDistance, index));
             }
         }
     }
 
-    // Clear queue (required as it is reused for the next pathfinding call)
-    while (!pq.empty())
-        pq.pop();
     return distances;
 }
 
-/** Returns the shortest path between the start and end point.
- * The costs per cell are given by the costs map.
- * Diagonal movement costs sqrt(2) times more than axis aligned movement.
+/** Dijkstra's algorithm from a single cell which stops once all the target cells have been reached.
+ * If reverse is true the costs are for going from each cell to the source, and the parents point towards the source.
  */
-vector<Point2DI> getPath(const Point2DI from, const Point2DI to, const InfluenceMap& costs) {
-    static vector<vector<double> > cost(MAX_MAP_SIZE, vector<double>(MAX_MAP_SIZE));
-    static vector<vector<int> > version(MAX_MAP_SIZE, vector<int>(MAX_MAP_SIZE));
-    static vector<vector<Point2DI> > parent(MAX_MAP_SIZE, vector<Point2DI>(MAX_MAP_SIZE));
-    static priority_queue<PathfindingEntry> pq;
-    static int pathfindingVersion = 0;
-
+static void searchUntilTargetsReached(int source, const vector<Point2DI>& targets, const InfluenceMap& costs, bool reverse, PathfindingContext& context) {
     int w = costs.w;
     int h = costs.h;
+    context.begin(w, h);
+    auto& cost = context.cost;
+    auto& parent = context.parent;
+    auto& generation = context.generation;
+    auto& targetGeneration = context.targetGeneration;
+    auto& pq = context.queue;
+    const uint32_t currentGeneration = context.currentGeneration;
+
+    int remainingTargets = 0;
+    for (auto p : targets) {
+        int index = p.y*w + p.x;
+        if (targetGeneration[index] != currentGeneration) {
+            targetGeneration[index] = currentGeneration;
+            remainingTargets++;
+        }
+    }
 
-    // Make sure map is sane
-    assert(w <= MAX_MAP_SIZE);
-    assert(h <= MAX_MAP_SIZE);
+    pushEntry(pq, PathfindingEntry(0.0, source));
+    cost[source] = 0;
+    generation[source] = currentGeneration;
+    parent[source] = source;
 
-    pathfindingVersion++;
+    while (!pq.empty() && remainingTargets > 0) {
+        auto currentEntry = popEntry(pq);
+        if (currentEntry.cost > cost[currentEntry.index]) {
+            continue;
+        }
 
-    pq.push(PathfindingEntry(0.0, from));
-    cost[from.x][from.y] = 0;
-    version[from.x][from.y] = pathfindingVersion;
-    parent[from.x][from.y] = from;
-    bool reached = false;
+        if (targetGeneration[currentEntry.index] == currentGeneration) {
+            // Clear the mark so that the target is only counted once
+            targetGeneration[currentEntry.index] = 0;
+            remainingTargets--;
+        }
 
-    while (!pq.empty()) {
-        auto currentEntry = pq.top();
-        auto currentPos = currentEntry.pos;
-        pq.pop();
-        if (currentEntry.cost > cost[currentPos.x][currentPos.y]) {
+        // In reverse the cost is for moving from the neighbour into the current cell
+        double reverseCost = costs.weights[currentEntry.index];
+        if (reverse && !isfinite(reverseCost)) continue;
+
+        int cx = currentEntry.index % w;
+        int cy = currentEntry.index / w;
+        for (int i = 0; i < 8; i++) {
+            int x = cx + dx[i];
+            int y = cy + dy[i];
+            if ((unsigned int)x >= (unsigned int)w || (unsigned int)y >= (unsigned int)h) {
+                continue;
+            }
+
+            int index = y*w + x;
+            double cellCost = reverse ? reverseCost : costs.weights[index];
+            if (!isfinite(cellCost)) continue;
+
+            double newCost = currentEntry.cost + cellCost * dc[i];
+            if (generation[index] != currentGeneration || newCost < cost[index]) {
+                cost[index] = newCost;
+                parent[index] = currentEntry.index;
+                generation[index] = currentGeneration;
+                pushEntry(pq, PathfindingEntry(newCost, index));
+            }
+        }
+    }
+}
+
+/** Follows the parents from the cell to the root of the search */
+static vector<Point2DI> followParents(int index, const PathfindingContext& context, int w) {
+    vector<Point2DI> path = { Point2DI(index % w, index / w) };
+    while (context.parent[index] != index) {
+        index = context.parent[index];
+        path.push_back(Point2DI(index % w, index / w));
+    }
+    return path;
+}
+
+vector<vector<Point2DI>> getPaths(const Point2DI from, const vector<Point2DI>& targets, const InfluenceMap& costs, PathfindingContext& context) {
+    int w = costs.w;
+    searchUntilTargetsReached(from.y*w + from.x, targets, costs, false, context);
+
+    vector<vector<Point2DI>> paths(targets.size());
+    for (size_t i = 0; i < targets.size(); i++) {
+        int index = targets[i].y*w + targets[i].x;
+        // All reachable targets are popped before the search stops, so any visited target has its final cost
+        if (!context.visited(index)) continue;
+
+        paths[i] = followParents(index, context, w);
+        reverse(paths[i].begin(), paths[i].end());
+    }
+    return paths;
+}
+
+vector<vector<Point2DI>> getPathsToTarget(const vector<Point2DI>& froms, const Point2DI to, const InfluenceMap& costs, PathfindingContext& context) {
+    int w = costs.w;
+    int toIndex = to.y*w + to.x;
+    vector<vector<Point2DI>> paths(froms.size());
+
+    // The target can never be entered, same as in getPath
+    if (!isfinite(costs.weights[toIndex])) return paths;
+
+    searchUntilTargetsReached(toIndex, froms, costs, true, context);
+    for (size_t i = 0; i < froms.size(); i++) {
+        int index = froms[i].y*w + froms[i].x;
+        if (context.visited(index)) paths[i] = followParents(index, context, w);
+    }
+    return paths;
+}
+
+/** Binary heap with exact priorities */
+struct HeapQueue {
+    vector<PathfindingEntry>& queue;
+
+    bool empty() const {
+        return queue.empty();
+    }
+
+    void push(const PathfindingEntry& entry) {
+        pushEntry(queue, entry);
+    }
+
+    PathfindingEntry pop() {
+        return popEntry(queue);
+    }
+};
+
+/** Radix queue with the priorities rounded to 1/BucketsPerUnit */
+struct BucketQueue {
+    static constexpr double BucketsPerUnit = 64;
+    PathfindingRadixQueue& queue;
+
+    bool empty() const {
+        return queue.empty();
+    }
+
+    void push(const PathfindingEntry& entry) {
+        // The heuristic is consistent, so the priorities never decrease except for rounding errors.
+        // Those are clamped to the last popped key.
+        double key = min((entry.cost + entry.h) * BucketsPerUnit, 4e9);
+        queue.push(max(queue.last, (uint32_t)key), entry);
+    }
+
+    PathfindingEntry pop() {
+        return queue.pop();
+    }
+};
+
+/** Octile distance between two cells, using the same diagonal cost as the search (1.41) */
+static inline double octileDistance(int x1, int y1, int x2, int y2) {
+    int ax = abs(x1 - x2);
+    int ay = abs(y1 - y2);
+    return max(ax, ay) + 0.41 * min(ax, ay);
+}
+
+/** The octile distance multiplied by the minimum cost is a lower bound on the cost of reaching the target, so it can be used as an A* heuristic */
+PathfindingCostInfo::PathfindingCostInfo(const InfluenceMap& costs) {
+    double mn = numeric_limits<double>::infinity();
+    double mx = -numeric_limits<double>::infinity();
+    for (double c : costs.weights) {
+        if (isfinite(c)) {
+            mn = min(mn, c);
+            mx = max(mx, c);
+        }
+    }
+    uniform = mn == mx;
+    minimumCost = isfinite(mn) && mn > 0 ? mn : 0;
+
+    if (uniform && minimumCost > 0) {
+        int w = costs.w;
+        int h = costs.h;
+        int stride = w + 2;
+        walkable.assign(stride * (h + 2), 0);
+        for (int y = 0; y < h; y++) {
+            for (int x = 0; x < w; x++) walkable[(y + 1) * stride + x + 1] = isfinite(costs.weights[y*w + x]);
+        }
+    }
+}
+
+template <class Queue>
+static bool searchPath(int fromIndex, int toIndex, const InfluenceMap& costs, double heuristicScale, PathfindingContext& context, Queue queue) {
+    int w = costs.w;
+    int h = costs.h;
+    auto& cost = context.cost;
+    auto& parent = context.parent;
+    auto& generation = context.generation;
+    const uint32_t currentGeneration = context.currentGeneration;
+    int tx = toIndex % w;
+    int ty = toIndex / w;
+
+    queue.push(PathfindingEntry(0.0, heuristicScale * octileDistance(fromIndex % w, fromIndex / w, tx, ty), fromIndex));
+    cost[fromIndex] = 0;
+    generation[fromIndex] = currentGeneration;
+    parent[fromIndex] = fromIndex;
+
+    while (!queue.empty()) {
+        auto currentEntry = queue.pop();
+        if (currentEntry.cost > cost[currentEntry.index]) {
             continue;
         }
 
-        if (currentEntry.pos == to) {
-            reached = true;
-            break;
+        if (currentEntry.index == toIndex) {
+            return true;
         }
 
+        int cx = currentEntry.index % w;
+        int cy = currentEntry.index / w;
         for (int i = 0; i < 8; i++) {
-            int x = currentPos.x + dx[i];
-            int y = currentPos.y + dy[i];
-            if (x < 0 || x >= w || y < 0 || y >= h) {
+            int x = cx + dx[i];
+            int y = cy + dy[i];
+            if ((unsigned int)x >= (unsigned int)w || (unsigned int)y >= (unsigned int)h) {
                 continue;
             }
-            // TODO: sqrt can be optimized
-            double newCost = currentEntry.cost + costs(x, y) * dc[i];
-            if ((newCost < cost[x][y] || version[x][y] != pathfindingVersion) && isfinite(cost[x][y])) {
-                cost[x][y] = newCost;
-                parent[x][y] = currentPos;
-                version[x][y] = pathfindingVersion;
-                pq.push(PathfindingEntry(newCost, 0 /* abs(x - to.x) + abs(y - to.y) */, Point2DI(x, y)));
+
+            int index = y*w + x;
+            double cellCost = costs.weights[index];
+            if (!isfinite(cellCost)) continue;
+
+            double newCost = currentEntry.cost + cellCost * dc[i];
+            if (generation[index] != currentGeneration || newCost < cost[index]) {
+                cost[index] = newCost;
+                parent[index] = currentEntry.index;
+                generation[index] = currentGeneration;
+                queue.push(PathfindingEntry(newCost, heuristicScale * octileDistance(x, y, tx, ty), index));
             }
         }
     }
 
-    // Clear queue (required as it is reused for the next pathfinding call)
-    while (!pq.empty())
-        pq.pop();
+    return false;
+}
+
+/** Walkable cells for jump point search, with a border of unwalkable cells around the map so that no bounds checks are needed */
+struct JumpGrid {
+    const uint8_t* walkable;
+    int stride;
+
+    inline bool free(int x, int y) const {
+        return walkable[(y + 1) * stride + x + 1];
+    }
+
+    /** True if the cell has a neighbour that can only be reached optimally through it when arriving in the direction (dx, dy) */
+    inline bool hasForcedNeighbour(int x, int y, int dx, int dy) const {
+        if (dx != 0 && dy != 0) {
+            return (!free(x - dx, y) && free(x - dx, y + dy)) || (!free(x, y - dy) && free(x + dx, y - dy));
+        } else if (dx != 0) {
+            return (!free(x, y + 1) && free(x + dx, y + 1)) || (!free(x, y - 1) && free(x + dx, y - 1));
+        } else {
+            return (!free(x + 1, y) && free(x + 1, y + dy)) || (!free(x - 1, y) && free(x - 1, y + dy));
+        }
+    }
+
+    /** Moves (x, y) in the direction (dx, dy) until a jump point is found.
+     * Returns false if an obstacle or the edge of the map was hit first.
+     */
+    bool jump(int& x, int& y, int dx, int dy, int tx, int ty) const {
+        while (true) {
+            x += dx;
+            y += dy;
+            if (!free(x, y)) return false;
+            if ((x == tx && y == ty) || hasForcedNeighbour(x, y, dx, dy)) return true;
+
+            if (dx != 0 && dy != 0) {
+                // Diagonal moves stop if a straight jump from the cell finds a jump point
+                int x2 = x, y2 = y;
+                if (jump(x2, y2, dx, 0, tx, ty)) return true;
+                x2 = x;
+                y2 = y;
+                if (jump(x2, y2, 0, dy, tx, ty)) return true;
+            }
+        }
+    }
+};
+
+static inline int sign(int v) {
+    return (v > 0) - (v < 0);
+}
+
+/** Jump point search (Harabor and Grastien 2011) for maps where all passable cells have the same cost.
+ * Only the jump points are added to the open list, so on open ground this expands orders of magnitude fewer cells than A*.
+ * The parents in the context are jump points, consecutive ones are always in a straight or diagonal line from each other.
+ * Finds paths with the same cost as the other algorithms.
+ */
+static bool jumpPointSearch(int fromIndex, int toIndex, const InfluenceMap& costs, const PathfindingCostInfo& costInfo, PathfindingContext& context) {
+    int w = costs.w;
+    double cellCost = costInfo.minimumCost;
+    assert((int)costInfo.walkable.size() == (w + 2) * (costs.h + 2));
+    JumpGrid grid { costInfo.walkable.data(), w + 2 };
+
+    auto& cost = context.cost;
+    auto& parent = context.parent;
+    auto& generation = context.generation;
+    auto& pq = context.queue;
+    const uint32_t currentGeneration = context.currentGeneration;
+    int tx = toIndex % w;
+    int ty = toIndex / w;
+
+    pushEntry(pq, PathfindingEntry(0.0, cellCost * octileDistance(fromIndex % w, fromIndex / w, tx, ty), fromIndex));
+    cost[fromIndex] = 0;
+    generation[fromIndex] = currentGeneration;
+    parent[fromIndex] = fromIndex;
+
+    int directions[8][2];
+    while (!pq.empty()) {
+        auto currentEntry = popEntry(pq);
+        if (currentEntry.cost > cost[currentEntry.index]) {
+            continue;
+        }
+
+        if (currentEntry.index == toIndex) {
+            return true;
+        }
+
+        int cx = currentEntry.index % w;
+        int cy = currentEntry.index / w;
+        int px = parent[currentEntry.index] % w;
+        int py = parent[currentEntry.index] / w;
+        int ddx = sign(cx - px);
+        int ddy = sign(cy - py);
+
+        // Directions worth searching in, given the direction we arrived from
+        int numDirections = 0;
+        if (ddx == 0 && ddy == 0) {
+            for (int i = 0; i < 8; i++) {
+                directions[numDirections][0] = dx[i];
+                directions[numDirections++][1] = dy[i];
+            }
+        } else if (ddx != 0 && ddy != 0) {
+            directions[numDirections][0] = ddx, directions[numDirections++][1] = 0;
+            directions[numDirections][0] = 0, directions[numDirections++][1] = ddy;
+            directions[numDirections][0] = ddx, directions[numDirections++][1] = ddy;
+            if (!grid.free(cx - ddx, cy)) directions[numDirections][0] = -ddx, directions[numDirections++][1] = ddy;
+            if (!grid.free(cx, cy - ddy)) directions[numDirections][0] = ddx, directions[numDirections++][1] = -ddy;
+        } else if (ddx != 0) {
+            directions[numDirections][0] = ddx, directions[numDirections++][1] = 0;
+            if (!grid.free(cx, cy + 1)) directions[numDirections][0] = ddx, directions[numDirections++][1] = 1;
+            if (!grid.free(cx, cy - 1)) directions[numDirections][0] = ddx, directions[numDirections++][1] = -1;
+        } else {
+            directions[numDirections][0] = 0, directions[numDirections++][1] = ddy;
+            if (!grid.free(cx + 1, cy)) directions[numDirections][0] = 1, directions[numDirections++][1] = ddy;
+            if (!grid.free(cx - 1, cy)) directions[numDirections][0] = -1, directions[numDirections++][1] = ddy;
+        }
+
+        for (int i = 0; i < numDirections; i++) {
+            int x = cx;
+            int y = cy;
+            if (!grid.jump(x, y, directions[i][0], directions[i][1], tx, ty)) continue;
+
+            int index = y*w + x;
+            double newCost = currentEntry.cost + cellCost * octileDistance(cx, cy, x, y);
+            if (generation[index] != currentGeneration || newCost < cost[index]) {
+                cost[index] = newCost;
+                parent[index] = currentEntry.index;
+                generation[index] = currentGeneration;
+                pushEntry(pq, PathfindingEntry(newCost, cellCost * octileDistance(x, y, tx, ty), index));
+            }
+        }
+    }
+
+    return false;
+}
+
+/** Returns the shortest path between the start and end point.
+ * The costs per cell are given by the costs map. Cells with an infinite cost are impassable.
+ * Diagonal movement costs sqrt(2) times more than axis aligned movement.
+ * Returns an empty path if the end point cannot be reached.
+ */
+vector<Point2DI> getPath(const Point2DI from, const Point2DI to, const InfluenceMap& costs, PathfindingAlgorithm algorithm, PathfindingContext& context) {
+    // Dijkstra's algorithm does not use the heuristic, so there is no need to scan the map
+    PathfindingCostInfo costInfo = algorithm == PathfindingAlgorithm::Dijkstra ? PathfindingCostInfo() : PathfindingCostInfo(costs);
+    return getPath(from, to, costs, costInfo, algorithm, context);
+}
+
+vector<Point2DI> getPath(const Point2DI from, const Point2DI to, const InfluenceMap& costs, const PathfindingCostInfo& costInfo, PathfindingAlgorithm algorithm, PathfindingContext& context) {
+    int w = costs.w;
+    int h = costs.h;
+
+    context.begin(w, h);
+    int fromIndex = from.y*w + from.x;
+    int toIndex = to.y*w + to.x;
+
+    bool uniform = costInfo.uniform;
+    double minimumCost = costInfo.minimumCost;
+    if (algorithm == PathfindingAlgorithm::Automatic) {
+        algorithm = uniform && minimumCost > 0 ? PathfindingAlgorithm::JumpPointSearch : PathfindingAlgorithm::AStar;
+    } else if (algorithm == PathfindingAlgorithm::JumpPointSearch && !(uniform && minimumCost > 0)) {
+        // Jump point search would find suboptimal paths
+        algorithm = PathfindingAlgorithm::AStar;
+    }
+
+    double heuristicScale = algorithm == PathfindingAlgorithm::Dijkstra ? 0 : minimumCost;
+    bool reached;
+    if (algorithm == PathfindingAlgorithm::JumpPointSearch) {
+        reached = jumpPointSearch(fromIndex, toIndex, costs, costInfo, context);
+    } else if (algorithm == PathfindingAlgorithm::AStarBuckets) {
+        context.radixQueue.clear();
+        reached = searchPath(fromIndex, toIndex, costs, heuristicScale, context, BucketQueue { context.radixQueue });
+    } else {
+        reached = searchPath(fromIndex, toIndex, costs, heuristicScale, context, HeapQueue { context.queue });
+    }
 
     if (!reached)
         return vector<Point2DI>();
 
-    Point2DI currentPos = to;
-    vector<Point2DI> path = { currentPos };
-    while (currentPos != from) {
-        auto p = parent[currentPos.x][currentPos.y];
-        path.push_back(p);
-        currentPos = p;
+    // Consecutive nodes may be several cells apart when using jump point search, so walk in a straight or diagonal line between them
+    int current = toIndex;
+    vector<Point2DI> path = { to };
+    while (current != fromIndex) {
+        int next = context.parent[current];
+        Point2DI p = path.back();
+        Point2DI target(next % w, next / w);
+        int sx = sign(target.x - p.x);
+        int sy = sign(target.y - p.y);
+        while (p != target) {
+            p.x += sx;
+            p.y += sy;
+            path.push_back(p);
+        }
+        current = next;
     }
     reverse(path.begin(), path.end());
     return path;
-}
\ No newline at end of file
+}
+
+/** Dijkstra's algorithm restricted to the rectangle [x0,x1) x [y0,y1) of the map.
+ * The distances and parents are indexed by the position inside the rectangle, the parents are cell indices in the whole map.
+ * If reverse is true the distances are the costs of going from each cell to the source,
+ * and the parent of a cell is the next cell on the way to the source.
+ */
+static void rectDijkstra(const InfluenceMap& costs, int x0, int y0, int x1, int y1, int source, bool reverse, vector<double>& dist, vector<int>& parent, vector<PathfindingEntry>& pq) {
+    int w = costs.w;
+    int rw = x1 - x0;
+    dist.assign(rw * (y1 - y0), numeric_limits<double>::infinity());
+    parent.assign(dist.size(), -1);
+    pq.clear();
+
+    int sx = source % w;
+    int sy = source / w;
+    dist[(sy - y0) * rw + sx - x0] = 0;
+    parent[(sy - y0) * rw + sx - x0] = source;
+    pushEntry(pq, PathfindingEntry(0.0, source));
+
+    while (!pq.empty()) {
+        auto currentEntry = popEntry(pq);
+        int cx = currentEntry.index % w;
+        int cy = currentEntry.index / w;
+        if (currentEntry.cost > dist[(cy - y0) * rw + cx - x0]) continue;
+
+        // In reverse the cost is for moving from the neighbour into the current cell
+        double reverseCost = costs.weights[currentEntry.index];
+        if (reverse && !isfinite(reverseCost)) continue;
+
+        for (int i = 0; i < 8; i++) {
+            int x = cx + dx[i];
+            int y = cy + dy[i];
+            if (x < x0 || y < y0 || x >= x1 || y >= y1) continue;
+
+            int index = y*w + x;
+            double cellCost = costs.weights[index];
+            if (!isfinite(cellCost)) continue;
+
+            double newCost = currentEntry.cost + (reverse ? reverseCost : cellCost) * dc[i];
+            int local = (y - y0) * rw + x - x0;
+            if (newCost < dist[local]) {
+                dist[local] = newCost;
+                parent[local] = currentEntry.index;
+                pushEntry(pq, PathfindingEntry(newCost, index));
+            }
+        }
+    }
+}
+
+HierarchicalPathfinder::HierarchicalPathfinder(const InfluenceMap& costs, int clusterSize) : costs(costs), clusterSize(clusterSize) {
+    assert(clusterSize > 0);
+    clustersX = (costs.w + clusterSize - 1) / clusterSize;
+    clustersY = (costs.h + clusterSize - 1) / clusterSize;
+    clusters.resize(clustersX * clustersY);
+    for (int cy = 0; cy < clustersY; cy++) {
+        for (int cx = 0; cx < clustersX; cx++) {
+            auto& cluster = clusters[cy * clustersX + cx];
+            cluster.x0 = cx * clusterSize;
+            cluster.y0 = cy * clusterSize;
+            cluster.x1 = min(costs.w, cluster.x0 + clusterSize);
+            cluster.y1 = min(costs.h, cluster.y0 + clusterSize);
+        }
+    }
+    nodeAt.assign(costs.w * costs.h, -1);
+}
+
+int HierarchicalPathfinder::clusterAt(int x, int y) const {
+    return (y / clusterSize) * clustersX + x / clusterSize;
+}
+
+void HierarchicalPathfinder::markDirty(int x, int y) {
+    clusters[clusterAt(x, y)].dirty = true;
+    dirty = true;
+}
+
+void HierarchicalPathfinder::setCost(Point2DI cell, double cost) {
+    if (costs(cell) != cost) {
+        costs(cell) = cost;
+        markDirty(cell.x, cell.y);
+    }
+}
+
+void HierarchicalPathfinder::setCosts(const InfluenceMap& newCosts) {
+    assert(newCosts.w == costs.w && newCosts.h == costs.h);
+    for (int y = 0; y < costs.h; y++) {
+        for (int x = 0; x < costs.w; x++) {
+            // NaN is never equal to itself, but an unchanged NaN cost should not mark the cluster as dirty
+            double a = costs(x, y);
+            double b = newCosts(x, y);
+            if (a != b && !(a != a && b != b)) markDirty(x, y);
+        }
+    }
+    costs = newCosts;
+}
+
+/** Adds the transitions on the border between the cluster and one of its neighbours.
+ * The transitions only depend on the cells along the border, so the neighbour will find the same transitions from its side.
+ */
+void HierarchicalPathfinder::addBorderTransitions(int clusterIndex, int neighbourIndex) {
+    auto& cluster = clusters[clusterIndex];
+    auto& neighbour = clusters[neighbourIndex];
+    int w = costs.w;
+
+    // Cells on the cluster's side of the border, and the offset to the cell on the other side
+    int start, step, length, offset;
+    if (neighbour.x0 == cluster.x1) {
+        start = cluster.y0 * w + cluster.x1 - 1, step = w, length = cluster.y1 - cluster.y0, offset = 1;
+    } else if (neighbour.x1 == cluster.x0) {
+        start = cluster.y0 * w + cluster.x0, step = w, length = cluster.y1 - cluster.y0, offset = -1;
+    } else if (neighbour.y0 == cluster.y1) {
+        start = (cluster.y1 - 1) * w + cluster.x0, step = 1, length = cluster.x1 - cluster.x0, offset = w;
+    } else {
+        start = cluster.y0 * w + cluster.x0, step = 1, length = cluster.x1 - cluster.x0, offset = -w;
+    }
+
+    auto addTransition = [&](int cell, int other, double factor) {
+        if (nodeAt[cell] == -1) {
+            nodeAt[cell] = cluster.nodes.size();
+            cluster.nodes.push_back(cell);
+            cluster.edges.emplace_back();
+        }
+        cluster.edges[nodeAt[cell]].push_back(Edge { other, costs.weights[other] * factor, { other } });
+    };
+
+    auto passable = [&](int cell) { return isfinite(costs.weights[cell]); };
+    vector<bool> open(length);
+    for (int i = 0; i < length; i++) open[i] = passable(start + i*step) && passable(start + i*step + offset);
+
+    int runStart = -1;
+    for (int i = 0; i <= length; i++) {
+        bool isOpen = i < length && open[i];
+        if (isOpen && runStart == -1) runStart = i;
+        if (!isOpen && runStart != -1) {
+            // Long openings get a transition at each end, short ones a single transition in the middle
+            int runLength = i - runStart;
+            if (runLength >= 6) {
+                addTransition(start + runStart * step, start + runStart * step + offset, 1);
+                addTransition(start + (i - 1) * step, start + (i - 1) * step + offset, 1);
+            } else {
+                int mid = start + (runStart + runLength / 2) * step;
+                addTransition(mid, mid + offset, 1);
+            }
+            runStart = -1;
+        }
+    }
+
+    // Gaps that can only be crossed diagonally
+    for (int i = 0; i < length; i++) {
+        int cell = start + i*step;
+        if (open[i] || !passable(cell)) continue;
+        for (int j : { i - 1, i + 1 }) {
+            if (j < 0 || j >= length) continue;
+            int other = start + j*step + offset;
+            if (!open[j] && passable(other)) addTransition(cell, other, 1.41);
+        }
+    }
+}
+
+void HierarchicalPathfinder::rebuildCluster(int clusterIndex) {
+    auto& cluster = clusters[clusterIndex];
+    for (int node : cluster.nodes) nodeAt[node] = -1;
+    cluster.nodes.clear();
+    cluster.edges.clear();
+
+    int cx = clusterIndex % clustersX;
+    int cy = clusterIndex / clustersX;
+    if (cx > 0) addBorderTransitions(clusterIndex, clusterIndex - 1);
+    if (cx < clustersX - 1) addBorderTransitions(clusterIndex, clusterIndex + 1);
+    if (cy > 0) addBorderTransitions(clusterIndex, clusterIndex - clustersX);
+    if (cy < clustersY - 1) addBorderTransitions(clusterIndex, clusterIndex + clustersX);
+
+    // Cache the shortest paths between all nodes inside the cluster
+    int w = costs.w;
+    int rw = cluster.x1 - cluster.x0;
+    vector<double> dist;
+    vector<int> parent;
+    vector<PathfindingEntry> pq;
+    for (size_t i = 0; i < cluster.nodes.size(); i++) {
+        rectDijkstra(costs, cluster.x0, cluster.y0, cluster.x1, cluster.y1, cluster.nodes[i], false, dist, parent, pq);
+        for (size_t j = 0; j < cluster.nodes.size(); j++) {
+            int target = cluster.nodes[j];
+            int local = (target / w - cluster.y0) * rw + target % w - cluster.x0;
+            if (i == j || !isfinite(dist[local])) continue;
+
+            Edge edge { target, dist[local], {} };
+            for (int c = target; c != cluster.nodes[i]; c = parent[(c / w - cluster.y0) * rw + c % w - cluster.x0]) edge.path.push_back(c);
+            reverse(edge.path.begin(), edge.path.end());
+            cluster.edges[i].push_back(move(edge));
+        }
+    }
+}
+
+void HierarchicalPathfinder::update() {
+    if (!dirty) return;
+
+    // Transitions on the borders of a changed cluster affect the neighbouring clusters too
+    vector<bool> rebuild(clusters.size());
+    for (int cy = 0; cy < clustersY; cy++) {
+        for (int cx = 0; cx < clustersX; cx++) {
+            if (!clusters[cy * clustersX + cx].dirty) continue;
+            for (int y = max(0, cy - 1); y <= min(clustersY - 1, cy + 1); y++) {
+                for (int x = max(0, cx - 1); x <= min(clustersX - 1, cx + 1); x++) {
+                    if (x == cx || y == cy) rebuild[y * clustersX + x] = true;
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < clusters.size(); i++) {
+        if (rebuild[i]) rebuildCluster(i);
+    }
+    for (auto& cluster : clusters) cluster.dirty = false;
+
+    minimumCost = PathfindingCostInfo(costs).minimumCost;
+    dirty = false;
+}
+
+vector<Point2DI> HierarchicalPathfinder::getPath(const Point2DI from, const Point2DI to, PathfindingContext& context) {
+    update();
+
+    int w = costs.w;
+    int fromIndex = from.y*w + from.x;
+    int toIndex = to.y*w + to.x;
+    if (!isfinite(costs.weights[toIndex])) return vector<Point2DI>();
+
+    // Connect the start and end points to the nodes in their clusters
+    auto& startCluster = clusters[clusterAt(from.x, from.y)];
+    auto& endCluster = clusters[clusterAt(to.x, to.y)];
+    int startWidth = startCluster.x1 - startCluster.x0;
+    int endWidth = endCluster.x1 - endCluster.x0;
+    auto startLocal = [&](int cell) { return (cell / w - startCluster.y0) * startWidth + cell % w - startCluster.x0; };
+    auto endLocal = [&](int cell) { return (cell / w - endCluster.y0) * endWidth + cell % w - endCluster.x0; };
+
+    vector<double> startDist, endDist;
+    vector<int> startParent, endParent;
+    rectDijkstra(costs, startCluster.x0, startCluster.y0, startCluster.x1, startCluster.y1, fromIndex, false, startDist, startParent, context.queue);
+    rectDijkstra(costs, endCluster.x0, endCluster.y0, endCluster.x1, endCluster.y1, toIndex, true, endDist, endParent, context.queue);
+
+    double bestCost = numeric_limits<double>::infinity();
+    // Node through which the best path reaches the end cluster, or -1 if the best path stays inside the start cluster
+    int bestNode = -1;
+    if (&startCluster == &endCluster) bestCost = startDist[startLocal(toIndex)];
+
+    // Search the graph of nodes, using cell indices to identify the nodes
+    context.begin(w, costs.h);
+    auto& cost = context.cost;
+    auto& parent = context.parent;
+    auto& generation = context.generation;
+    auto& pq = context.queue;
+    const uint32_t currentGeneration = context.currentGeneration;
+    for (int node : startCluster.nodes) {
+        double d = startDist[startLocal(node)];
+        if (!isfinite(d)) continue;
+        cost[node] = d;
+        parent[node] = -1;
+        generation[node] = currentGeneration;
+        pushEntry(pq, PathfindingEntry(d, minimumCost * octileDistance(node % w, node / w, to.x, to.y), node));
+    }
+
+    while (!pq.empty()) {
+        auto currentEntry = popEntry(pq);
+        if (currentEntry.cost + currentEntry.h >= bestCost) break;
+        if (currentEntry.cost > cost[currentEntry.index]) continue;
+
+        int node = currentEntry.index;
+        int nx = node % w;
+        int ny = node / w;
+        if (&clusters[clusterAt(nx, ny)] == &endCluster) {
+            double total = currentEntry.cost + endDist[endLocal(node)];
+            if (total < bestCost) {
+                bestCost = total;
+                bestNode = node;
+            }
+        }
+
+        auto& cluster = clusters[clusterAt(nx, ny)];
+        for (auto& edge : cluster.edges[nodeAt[node]]) {
+            double newCost = currentEntry.cost + edge.cost;
+            if (generation[edge.target] != currentGeneration || newCost < cost[edge.target]) {
+                cost[edge.target] = newCost;
+                parent[edge.target] = node;
+                generation[edge.target] = currentGeneration;
+                pushEntry(pq, PathfindingEntry(newCost, minimumCost * octileDistance(edge.target % w, edge.target / w, to.x, to.y), edge.target));
+            }
+        }
+    }
+
+    if (!isfinite(bestCost)) return vector<Point2DI>();
+
+    vector<int> cells;
+    int firstNode = bestNode == -1 ? toIndex : bestNode;
+
+    // From the end cluster node to the end point. The cells are collected in reverse order
+    if (bestNode != -1) {
+        for (int c = bestNode; c != toIndex; ) {
+            c = endParent[endLocal(c)];
+            cells.push_back(c);
+        }
+        reverse(cells.begin(), cells.end());
+    }
+
+    // Cached paths between the nodes
+    if (bestNode != -1) {
+        for (int node = bestNode; parent[node] != -1; node = parent[node]) {
+            int p = parent[node];
+            const Edge* best = nullptr;
+            for (auto& edge : clusters[clusterAt(p % w, p / w)].edges[nodeAt[p]]) {
+                if (edge.target == node && (best == nullptr || edge.cost < best->cost)) best = &edge;
+            }
+            assert(best != nullptr);
+            cells.insert(cells.end(), best->path.rbegin(), best->path.rend());
+            firstNode = p;
+        }
+    }
+
+    // From the first node back to the start point
+    for (int c = firstNode; c != fromIndex; c = startParent[startLocal(c)]) cells.push_back(c);
+    cells.push_back(fromIndex);
+
+    vector<Point2DI> path;
+    path.reserve(cells.size());
+    for (auto it = cells.rbegin(); it != cells.rend(); it++) path.push_back(Point2DI(*it % w, *it / w));
+    return path;
+}
+
+DistanceField::DistanceField(const InfluenceMap& costs) : costs(costs), distances(costs.w, costs.h), parent(costs.w * costs.h, -1), sources(costs.w * costs.h, 0) {
+    for (auto& d : distances.weights) d = numeric_limits<double>::infinity();
+}
+
+DistanceField::DistanceField(const InfluenceMap& startingPoints, const InfluenceMap& costs) : DistanceField(costs) {
+    setSources(startingPoints);
+}
+
+void DistanceField::addSource(Point2DI cell) {
+    int index = cell.y * costs.w + cell.x;
+    if (!sources[index]) {
+        sources[index] = 1;
+        decreased.push_back(index);
+    }
+}
+
+void DistanceField::removeSource(Point2DI cell) {
+    int index = cell.y * costs.w + cell.x;
+    if (sources[index]) {
+        sources[index] = 0;
+        increased.push_back(index);
+    }
+}
+
+void DistanceField::setSources(const InfluenceMap& startingPoints) {
+    assert(startingPoints.w == costs.w && startingPoints.h == costs.h);
+    for (int y = 0; y < costs.h; y++) {
+        for (int x = 0; x < costs.w; x++) {
+            if (startingPoints(x, y)) addSource(Point2DI(x, y));
+            else removeSource(Point2DI(x, y));
+        }
+    }
+}
+
+void DistanceField::setCost(Point2DI cell, double cost) {
+    int index = cell.y * costs.w + cell.x;
+    double previous = costs.weights[index];
+    if (previous == cost || (isnan(previous) && isnan(cost))) return;
+
+    costs.weights[index] = cost;
+    if (cost < previous) decreased.push_back(index);
+    else increased.push_back(index);
+}
+
+void DistanceField::setCosts(const InfluenceMap& newCosts) {
+    assert(newCosts.w == costs.w && newCosts.h == costs.h);
+    for (int y = 0; y < costs.h; y++) {
+        for (int x = 0; x < costs.w; x++) setCost(Point2DI(x, y), newCosts(x, y));
+    }
+}
+
+/** Shortest distance to the cell through any of its neighbours, using the current distances of the neighbours.
+ * The neighbour the shortest distance goes through is stored in bestParent (-1 for sources and unreachable cells).
+ */
+double DistanceField::bestDistanceFromNeighbours(int index, int& bestParent) const {
+    bestParent = -1;
+    if (sources[index]) return 0;
+
+    double cellCost = costs.weights[index];
+    if (isinf(cellCost)) return numeric_limits<double>::infinity();
+
+    int w = costs.w;
+    int h = costs.h;
+    int cx = index % w;
+    int cy = index / w;
+    double best = numeric_limits<double>::infinity();
+    for (int i = 0; i < 8; i++) {
+        int x = cx + dx[i];
+        int y = cy + dy[i];
+        if ((unsigned int)x >= (unsigned int)w || (unsigned int)y >= (unsigned int)h) continue;
+        double d = distances.weights[y*w + x] + cellCost * dc[i];
+        if (d < best) {
+            best = d;
+            bestParent = y*w + x;
+        }
+    }
+    return best;
+}
+
+void DistanceField::update() {
+    if (increased.empty() && decreased.empty()) return;
+
+    int w = costs.w;
+    int h = costs.h;
+    auto& dist = distances.weights;
+
+    // Invalidate all cells whose shortest path went through a cell whose distance may have increased
+    invalidated.clear();
+    for (int index : increased) {
+        if (isinf(dist[index])) continue;
+        dist[index] = numeric_limits<double>::infinity();
+        parent[index] = -1;
+        invalidated.push_back(index);
+    }
+    for (size_t k = 0; k < invalidated.size(); k++) {
+        int index = invalidated[k];
+        int cx = index % w;
+        int cy = index / w;
+        for (int i = 0; i < 8; i++) {
+            int x = cx + dx[i];
+            int y = cy + dy[i];
+            if ((unsigned int)x >= (unsigned int)w || (unsigned int)y >= (unsigned int)h) continue;
+
+            int neighbour = y*w + x;
+            if (parent[neighbour] == index) {
+                dist[neighbour] = numeric_limits<double>::infinity();
+                parent[neighbour] = -1;
+                invalidated.push_back(neighbour);
+            }
+        }
+    }
+
+    // Seed the queue with the invalidated cells and the cells whose distance may have decreased,
+    // using the distances from their neighbours that are still valid
+    queue.clear();
+    auto seed = [&](int index) {
+        int bestParent;
+        double d = bestDistanceFromNeighbours(index, bestParent);
+        if (d < dist[index] || (sources[index] && parent[index] != -1)) {
+            dist[index] = d;
+            parent[index] = bestParent;
+            pushEntry(queue, PathfindingEntry(d, index));
+        }
+    };
+    for (int index : invalidated) seed(index);
+    for (int index : decreased) seed(index);
+    increased.clear();
+    decreased.clear();
+
+    // Propagate the new distances outwards, same as in getDistances
+    while (!queue.empty()) {
+        auto currentEntry = popEntry(queue);
+        if (currentEntry.cost > dist[currentEntry.index]) continue;
+
+        int cx = currentEntry.index % w;
+        int cy = currentEntry.index / w;
+        for (int i = 0; i < 8; i++) {
+            int x = cx + dx[i];
+            int y = cy + dy[i];
+            if ((unsigned int)x >= (unsigned int)w || (unsigned int)y >= (unsigned int)h) continue;
+
+            int index = y*w + x;
+            double cellCost = costs.weights[index];
+            if (isinf(cellCost)) continue;
+
+            double newDistance = currentEntry.cost + cellCost * dc[i];
+            if (newDistance < dist[index]) {
+                dist[index] = newDistance;
+                parent[index] = currentEntry.index;
+                pushEntry(queue, PathfindingEntry(newDistance, index));
+            }
+        }
+    }
+}
+
+double DistanceField::distance(Point2DI cell) {
+    update();
+    return distances(cell);
+}
+
+const InfluenceMap& DistanceField::getDistances() {
+    update();
+    return distances;
+}
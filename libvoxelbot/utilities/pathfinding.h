@@ -1,7 +1,239 @@
 #pragma once
 #include <libvoxelbot/utilities/influence.h>
 #include "sc2api/sc2_api.h"
+#include <cstdint>
+#include <utility>
 #include <vector>
 
-std::vector<sc2::Point2DI> getPath (const sc2::Point2DI from, const sc2::Point2DI to, const InfluenceMap& costs);
-InfluenceMap getDistances (const InfluenceMap& startingPoints, const InfluenceMap& costs);
\ No newline at end of file
+struct PathfindingEntry {
+    double cost;
+    double h;
+    int index;
+
+    PathfindingEntry(double _cost, int _index)
+        : cost(_cost), h(0), index(_index) {
+    }
+
+    PathfindingEntry(double _cost, double _h, int _index)
+        : cost(_cost), h(_h), index(_index) {
+    }
+
+    /** Ordering for a max-heap. Entries with the lowest cost + heuristic come first.
+     * Ties are broken in favour of the entry with the highest cost, i.e. the one closest to the goal, which makes A* expand far fewer cells on open ground.
+     */
+    bool operator<(const PathfindingEntry& other) const {
+        double f = cost + h;
+        double otherF = other.cost + other.h;
+        return f != otherF ? f > otherF : cost < other.cost;
+    }
+};
+
+/** Monotone priority queue with integer keys (a radix heap).
+ * The key of every pushed entry must be at least as large as the key of the last popped entry.
+ * Push is O(1) and pop is amortized O(log C) where C is the range of the keys, which is cheaper than a binary heap
+ * as each entry is only moved between buckets a few times.
+ * Entries with the same key are popped in last in, first out order.
+ */
+struct PathfindingRadixQueue {
+    std::vector<std::pair<uint32_t, PathfindingEntry>> buckets[33];
+    uint32_t last = 0;
+    size_t count = 0;
+
+    bool empty() const {
+        return count == 0;
+    }
+
+    void clear();
+    void push(uint32_t key, const PathfindingEntry& entry);
+    PathfindingEntry pop();
+};
+
+enum class PathfindingAlgorithm {
+    /** JumpPointSearch if all passable cells have the same cost, otherwise AStar */
+    Automatic,
+    /** Dijkstra's algorithm, explores cells in all directions */
+    Dijkstra,
+    /** A* with an octile distance heuristic. Finds the same path cost as Dijkstra's algorithm */
+    AStar,
+    /** A* using a radix queue with the priorities rounded to 1/64 of a unit of cost.
+     * Usually faster than AStar, but the path may be up to about 1/64 more expensive than the optimal one for every cell in the path in the worst case.
+     */
+    AStarBuckets,
+    /** Jump point search. Much faster than AStar with the same path cost, but only works if all passable cells have the same positive cost.
+     * AStar is used instead on other maps.
+     */
+    JumpPointSearch,
+};
+
+/** Scratch memory for the pathfinding functions.
+ * All buffers are flat and stored in row-major order (same as InfluenceMap), and they are reused between searches.
+ * Instead of clearing the buffers before every search, each cell is stamped with the generation of the search that last touched it.
+ *
+ * A context must not be used by several threads at the same time. Each worker thread should own its own context,
+ * or use #threadLocal which is what the functions use if no context is given.
+ */
+struct PathfindingContext {
+    std::vector<double> cost;
+    std::vector<int> parent;
+    std::vector<uint32_t> generation;
+    /** Marks the cells that are targets in the current search, using the same generation stamps */
+    std::vector<uint32_t> targetGeneration;
+    /** Binary heap ordered using std::push_heap and std::pop_heap */
+    std::vector<PathfindingEntry> queue;
+    PathfindingRadixQueue radixQueue;
+    uint32_t currentGeneration = 0;
+
+    /** Prepares the context for a new search on a map of the given size */
+    void begin(int w, int h);
+
+    inline bool visited(int index) const {
+        return generation[index] == currentGeneration;
+    }
+
+    /** Context owned by the calling thread */
+    static PathfindingContext& threadLocal();
+};
+
+/** Properties of a cost map that #getPath uses to choose the algorithm and to scale the heuristic.
+ * Calculating them scans the whole map, so when running many searches on the same map they should be calculated once and passed to #getPath.
+ * They must be recalculated when the costs change.
+ */
+struct PathfindingCostInfo {
+    /** Lowest finite cost of any cell, or zero if there are no finite costs or the lowest cost is not positive */
+    double minimumCost = 0;
+    /** True if all finite costs in the map are the same */
+    bool uniform = false;
+    /** Walkable cells for jump point search, with a border around the map. Only calculated if the costs are uniform */
+    std::vector<uint8_t> walkable;
+
+    PathfindingCostInfo() {}
+    explicit PathfindingCostInfo(const InfluenceMap& costs);
+};
+
+/** Returns the shortest path between the start and end point, or an empty path if the end point cannot be reached.
+ * Unless the algorithm is Dijkstra this scans the whole cost map first, use the overload taking a #PathfindingCostInfo to avoid that.
+ */
+std::vector<sc2::Point2DI> getPath (const sc2::Point2DI from, const sc2::Point2DI to, const InfluenceMap& costs, PathfindingAlgorithm algorithm = PathfindingAlgorithm::Automatic, PathfindingContext& context = PathfindingContext::threadLocal());
+/** Same as above, but using properties of the cost map that were calculated in advance */
+std::vector<sc2::Point2DI> getPath (const sc2::Point2DI from, const sc2::Point2DI to, const InfluenceMap& costs, const PathfindingCostInfo& costInfo, PathfindingAlgorithm algorithm = PathfindingAlgorithm::Automatic, PathfindingContext& context = PathfindingContext::threadLocal());
+InfluenceMap getDistances (const InfluenceMap& startingPoints, const InfluenceMap& costs, PathfindingContext& context = PathfindingContext::threadLocal());
+
+/** Returns the shortest paths from a single start point to each of the targets, in the same order as the targets.
+ * Runs a single search that stops once all targets have been reached, which is much faster than calling #getPath for every target.
+ * Paths to targets that cannot be reached are empty.
+ */
+std::vector<std::vector<sc2::Point2DI>> getPaths (const sc2::Point2DI from, const std::vector<sc2::Point2DI>& targets, const InfluenceMap& costs, PathfindingContext& context = PathfindingContext::threadLocal());
+
+/** Returns the shortest paths from each of the start points to a single target, in the same order as the start points.
+ * Runs a single search backwards from the target that stops once all start points have been reached.
+ * Paths from start points that cannot reach the target are empty.
+ */
+std::vector<std::vector<sc2::Point2DI>> getPathsToTarget (const std::vector<sc2::Point2DI>& froms, const sc2::Point2DI to, const InfluenceMap& costs, PathfindingContext& context = PathfindingContext::threadLocal());
+
+/** Hierarchical pathfinder (HPA*) for long range queries on a map that changes rarely.
+ *
+ * The map is split into square clusters. Cells on both sides of the borders between clusters are connected by transitions
+ * (one for every short opening in the border, two for long ones). The shortest paths inside each cluster between all its transition cells
+ * are precomputed and cached, so a query only has to search inside the clusters of the start and end points
+ * and then search the small graph of transitions.
+ * The paths are usually a few percent more expensive than the ones from #getPath, as they have to pass through the transition cells.
+ * Diagonal moves between clusters that only touch at a corner are not used, in the rare cases where that is the only way through the path will not be found.
+ *
+ * When costs change only the affected clusters and their neighbours are recomputed, the next time #update or #getPath is called.
+ * Queries do not modify the pathfinder after #update has been called, so several threads can then run queries at the same time as long as they use different contexts.
+ */
+struct HierarchicalPathfinder {
+    struct Edge {
+        /** Cell index of the node at the other end of the edge */
+        int target;
+        double cost;
+        /** Cells along the edge, excluding the node the edge starts at but including the target */
+        std::vector<int> path;
+    };
+
+    struct Cluster {
+        int x0, y0, x1, y1;
+        /** Cell indices of the nodes in this cluster */
+        std::vector<int> nodes;
+        /** Outgoing edges for each node */
+        std::vector<std::vector<Edge>> edges;
+        bool dirty = true;
+    };
+
+    InfluenceMap costs;
+    int clusterSize;
+    int clustersX, clustersY;
+    std::vector<Cluster> clusters;
+    /** Index of the node in its cluster for every cell, or -1 if the cell is not a node */
+    std::vector<int> nodeAt;
+    /** Lowest cost of any cell, used for the heuristic */
+    double minimumCost = 0;
+    bool dirty = true;
+
+    HierarchicalPathfinder(const InfluenceMap& costs, int clusterSize = 16);
+
+    /** Changes the cost of a single cell, e.g. when a building is placed or destroyed */
+    void setCost(sc2::Point2DI cell, double cost);
+
+    /** Replaces the cost map. Only clusters where some cell changed are recomputed */
+    void setCosts(const InfluenceMap& newCosts);
+
+    /** Recomputes all clusters affected by cost changes */
+    void update();
+
+    /** Returns a path between the start and end point, or an empty path if the end point cannot be reached.
+     * Same format as the path from #getPath.
+     */
+    std::vector<sc2::Point2DI> getPath(const sc2::Point2DI from, const sc2::Point2DI to, PathfindingContext& context = PathfindingContext::threadLocal());
+
+private:
+    int clusterAt(int x, int y) const;
+    void markDirty(int x, int y);
+    void addBorderTransitions(int clusterIndex, int neighbourIndex);
+    void rebuildCluster(int clusterIndex);
+};
+
+/** Distances from a set of source cells which are kept up to date when the sources or the costs change.
+ * Gives the same distances as #getDistances, but after small changes only the cells whose shortest path is affected are recomputed.
+ * When a source is removed or a cost increases, all cells whose shortest path went through that cell are invalidated and recomputed from their neighbours.
+ * When a source is added or a cost decreases, the improvement is propagated outwards from that cell.
+ *
+ * Changes are applied lazily the next time the distances are requested, or when #update is called.
+ */
+struct DistanceField {
+    InfluenceMap costs;
+    InfluenceMap distances;
+    /** Previous cell on the shortest path from the closest source, or -1 for sources and unreachable cells */
+    std::vector<int> parent;
+    std::vector<uint8_t> sources;
+
+    DistanceField(const InfluenceMap& costs);
+    /** A point is considered a source if the element in the startingPoints map is non-zero (same as #getDistances) */
+    DistanceField(const InfluenceMap& startingPoints, const InfluenceMap& costs);
+
+    void addSource(sc2::Point2DI cell);
+    void removeSource(sc2::Point2DI cell);
+    /** Replaces all sources. Only the cells that changed are updated */
+    void setSources(const InfluenceMap& startingPoints);
+
+    void setCost(sc2::Point2DI cell, double cost);
+    /** Replaces the cost map. Only the cells that changed are updated */
+    void setCosts(const InfluenceMap& newCosts);
+
+    /** Applies all pending changes */
+    void update();
+
+    /** Distance from the closest source to the cell */
+    double distance(sc2::Point2DI cell);
+
+    const InfluenceMap& getDistances();
+
+private:
+    /** Cells where the distance may have become larger or smaller respectively, since the last update */
+    std::vector<int> increased;
+    std::vector<int> decreased;
+    std::vector<PathfindingEntry> queue;
+    std::vector<int> invalidated;
+
+    double bestDistanceFromNeighbours(int index, int& bestParent) const;
+};
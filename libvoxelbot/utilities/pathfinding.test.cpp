@@ -0,0 +1,219 @@
+#include <libvoxelbot/utilities/pathfinding.h>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <thread>
+
+using namespace std;
+using namespace sc2;
+
+static double pathCost(const vector<Point2DI>& path, const InfluenceMap& costs) {
+    double result = 0;
+    for (size_t i = 1; i < path.size(); i++) {
+        int dist = abs(path[i].x - path[i-1].x) + abs(path[i].y - path[i-1].y);
+        assert(dist == 1 || dist == 2);
+        result += costs(path[i]) * (dist == 2 ? 1.41 : 1);
+    }
+    return result;
+}
+
+static InfluenceMap randomCosts(int w, int h, default_random_engine& rnd) {
+    InfluenceMap costs(w, h);
+    for (auto& c : costs.weights) c = rnd() % 5 == 0 ? numeric_limits<double>::infinity() : 1 + rnd() % 3;
+    return costs;
+}
+
+int main() {
+    default_random_engine rnd(123);
+    InfluenceMap costs = randomCosts(100, 80, rnd);
+
+    for (int i = 0; i < 200; i++) {
+        Point2DI from(rnd() % costs.w, rnd() % costs.h);
+        Point2DI to(rnd() % costs.w, rnd() % costs.h);
+        costs(from) = 1;
+        costs(to) = 1;
+
+        InfluenceMap startingPoints(costs.w, costs.h);
+        startingPoints(from) = 1;
+        double expected = getDistances(startingPoints, costs)(to);
+
+        auto dijkstra = getPath(from, to, costs, PathfindingAlgorithm::Dijkstra);
+        auto astar = getPath(from, to, costs, PathfindingAlgorithm::AStar);
+        auto buckets = getPath(from, to, costs, PathfindingAlgorithm::AStarBuckets);
+        assert(astar == getPath(from, to, costs, PathfindingCostInfo(costs), PathfindingAlgorithm::AStar));
+        // Jump point search does not work when the costs differ, so A* is used instead
+        assert(astar == getPath(from, to, costs, PathfindingAlgorithm::JumpPointSearch));
+
+        if (isinf(expected)) {
+            assert(dijkstra.empty());
+            assert(astar.empty());
+            assert(buckets.empty());
+            continue;
+        }
+
+        for (auto* path : { &dijkstra, &astar, &buckets }) {
+            assert(path->front() == from);
+            assert(path->back() == to);
+            for (auto p : *path) assert(isfinite(costs(p)));
+        }
+
+        assert(abs(pathCost(dijkstra, costs) - expected) < 1e-9);
+        assert(abs(pathCost(astar, costs) - expected) < 1e-9);
+        // The bucketed queue only guarantees a nearly optimal path
+        assert(pathCost(buckets, costs) <= expected * 1.05 + 1e-9);
+    }
+
+    {
+        // Jump point search on maps where all passable cells have the same cost
+        for (int k = 0; k < 4; k++) {
+            InfluenceMap uniform(90, 70);
+            double cellCost = 1 + k;
+            int obstacleFrequency = 3 + k * 4;
+            for (auto& c : uniform.weights) c = rnd() % obstacleFrequency == 0 ? numeric_limits<double>::infinity() : cellCost;
+
+            for (int i = 0; i < 100; i++) {
+                Point2DI from(rnd() % uniform.w, rnd() % uniform.h);
+                Point2DI to(rnd() % uniform.w, rnd() % uniform.h);
+                uniform(from) = cellCost;
+                uniform(to) = cellCost;
+
+                auto dijkstra = getPath(from, to, uniform, PathfindingAlgorithm::Dijkstra);
+                auto jps = getPath(from, to, uniform, PathfindingAlgorithm::JumpPointSearch);
+                auto automatic = getPath(from, to, uniform);
+                PathfindingCostInfo costInfo(uniform);
+                assert(costInfo.uniform && costInfo.minimumCost == cellCost);
+                auto cached = getPath(from, to, uniform, costInfo);
+                assert(dijkstra.empty() == jps.empty());
+                assert(jps == automatic);
+                assert(jps == cached);
+                if (jps.empty()) continue;
+
+                assert(jps.front() == from);
+                assert(jps.back() == to);
+                for (auto p : jps) assert(isfinite(uniform(p)));
+                assert(abs(pathCost(jps, uniform) - pathCost(dijkstra, uniform)) < 1e-9);
+            }
+        }
+    }
+
+    {
+        // The hierarchical pathfinder should find paths whenever they exist, and they should be close to optimal
+        InfluenceMap costs3 = randomCosts(100, 90, rnd);
+        HierarchicalPathfinder hierarchical(costs3, 16);
+        for (int k = 0; k < 3; k++) {
+            for (int i = 0; i < 100; i++) {
+                Point2DI from(rnd() % costs3.w, rnd() % costs3.h);
+                Point2DI to(rnd() % costs3.w, rnd() % costs3.h);
+                auto optimal = getPath(from, to, hierarchical.costs, PathfindingAlgorithm::Dijkstra);
+                auto path = hierarchical.getPath(from, to);
+                assert(optimal.empty() == path.empty());
+                if (path.empty()) continue;
+
+                assert(path.front() == from);
+                assert(path.back() == to);
+                for (size_t j = 1; j < path.size(); j++) assert(isfinite(hierarchical.costs(path[j])));
+                assert(pathCost(path, hierarchical.costs) <= pathCost(optimal, hierarchical.costs) * 1.5 + 1e-9);
+            }
+
+            // Place and destroy some buildings
+            for (int i = 0; i < 20; i++) {
+                Point2DI p(rnd() % costs3.w, rnd() % costs3.h);
+                hierarchical.setCost(p, rnd() % 2 == 0 ? numeric_limits<double>::infinity() : 1);
+            }
+        }
+    }
+
+    {
+        // Incrementally updated distance fields should always match distances computed from scratch
+        InfluenceMap costs4 = randomCosts(60, 50, rnd);
+        InfluenceMap startingPoints(costs4.w, costs4.h);
+        for (int i = 0; i < 5; i++) startingPoints(rnd() % costs4.w, rnd() % costs4.h) = 1;
+        DistanceField field(startingPoints, costs4);
+
+        for (int i = 0; i < 100; i++) {
+            Point2DI p(rnd() % costs4.w, rnd() % costs4.h);
+            switch(rnd() % 3) {
+                case 0:
+                    startingPoints(p) = 1;
+                    field.addSource(p);
+                    break;
+                case 1:
+                    startingPoints(p) = 0;
+                    field.removeSource(p);
+                    break;
+                default: {
+                    double c = rnd() % 4 == 0 ? numeric_limits<double>::infinity() : 1 + rnd() % 3;
+                    costs4(p) = c;
+                    field.setCost(p, c);
+                    break;
+                }
+            }
+
+            auto expected = getDistances(startingPoints, costs4);
+            auto& distances = field.getDistances();
+            for (size_t j = 0; j < expected.weights.size(); j++) {
+                assert(isinf(expected.weights[j]) == isinf(distances.weights[j]));
+                assert(isinf(expected.weights[j]) || abs(expected.weights[j] - distances.weights[j]) < 1e-9);
+            }
+            assert(field.distance(p) == distances(p));
+        }
+    }
+
+    {
+        // Batched queries should give paths with the same costs as separate queries
+        Point2DI center(rnd() % costs.w, rnd() % costs.h);
+        vector<Point2DI> points;
+        for (int i = 0; i < 30; i++) points.push_back(Point2DI(rnd() % costs.w, rnd() % costs.h));
+        points.push_back(center);
+        points.push_back(points[0]);
+
+        auto pathsFrom = getPaths(center, points, costs);
+        auto pathsTo = getPathsToTarget(points, center, costs);
+        assert(pathsFrom.size() == points.size());
+        assert(pathsTo.size() == points.size());
+        for (size_t i = 0; i < points.size(); i++) {
+            auto expectedFrom = getPath(center, points[i], costs, PathfindingAlgorithm::Dijkstra);
+            auto expectedTo = getPath(points[i], center, costs, PathfindingAlgorithm::Dijkstra);
+            assert(expectedFrom.empty() == pathsFrom[i].empty());
+            assert(expectedTo.empty() == pathsTo[i].empty());
+            if (!pathsFrom[i].empty()) {
+                assert(pathsFrom[i].front() == center && pathsFrom[i].back() == points[i]);
+                assert(abs(pathCost(pathsFrom[i], costs) - pathCost(expectedFrom, costs)) < 1e-9);
+            }
+            if (!pathsTo[i].empty()) {
+                assert(pathsTo[i].front() == points[i] && pathsTo[i].back() == center);
+                assert(abs(pathCost(pathsTo[i], costs) - pathCost(expectedTo, costs)) < 1e-9);
+            }
+        }
+    }
+
+    {
+        // Separate threads should get the same results as they use separate contexts
+        InfluenceMap costs2 = randomCosts(128, 128, rnd);
+        vector<Point2DI> starts, ends;
+        for (int i = 0; i < 50; i++) {
+            starts.push_back(Point2DI(rnd() % costs2.w, rnd() % costs2.h));
+            ends.push_back(Point2DI(rnd() % costs2.w, rnd() % costs2.h));
+        }
+
+        vector<vector<Point2DI>> expected;
+        for (int i = 0; i < 50; i++) expected.push_back(getPath(starts[i], ends[i], costs2));
+
+        vector<thread> threads;
+        vector<int> mismatches(4);
+        for (int t = 0; t < 4; t++) {
+            threads.push_back(thread([&, t]() {
+                for (int k = 0; k < 10; k++) {
+                    for (int i = 0; i < 50; i++) {
+                        if (getPath(starts[i], ends[i], costs2) != expected[i]) mismatches[t]++;
+                    }
+                }
+            }));
+        }
+        for (auto& t : threads) t.join();
+        for (int m : mismatches) assert(m == 0);
+    }
+
+    cout << "Pathfinding tests passed" << endl;
+    return 0;
+}
@@ -64,6 +64,14 @@ void MapRenderer::renderInfluenceMapNormalized(const InfluenceMap& influenceMap,
     renderImageGrayscale((double*)influenceMap.weights.data(), influenceMap.w, influenceMap.h, InfluenceMapScale * x0 * (influenceMap.w + 5), InfluenceMapScale * y0 * (influenceMap.h + 5), InfluenceMapScale, true);
 }
 
+void MapRenderer::renderInfluenceMap(const InfluenceMapF& influenceMap, int x0, int y0) {
+    renderInfluenceMap(convertInfluenceMap<double>(influenceMap), x0, y0);
+}
+
+void MapRenderer::renderInfluenceMapNormalized(const InfluenceMapF& influenceMap, int x0, int y0) {
+    renderInfluenceMapNormalized(convertInfluenceMap<double>(influenceMap), x0, y0);
+}
+
 void MapRenderer::renderMatrix1BPP(const char* bytes, int w_mat, int h_mat, int off_x, int off_y, int px_w, int px_h) {
     if (!window) return;
     assert(renderer);
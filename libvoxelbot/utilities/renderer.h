@@ -1,7 +1,10 @@
 #pragma once
 #include "SDL.h"
 
-struct InfluenceMap;
+template<class T>
+struct InfluenceMapT;
+typedef InfluenceMapT<double> InfluenceMap;
+typedef InfluenceMapT<float> InfluenceMapF;
 
 struct MapRenderer {
   private:
@@ -14,6 +17,8 @@ struct MapRenderer {
     void shutdown();
     void renderInfluenceMap(const InfluenceMap& influenceMap, int x0, int y0);
     void renderInfluenceMapNormalized(const InfluenceMap& influenceMap, int x0, int y0);
+    void renderInfluenceMap(const InfluenceMapF& influenceMap, int x0, int y0);
+    void renderInfluenceMapNormalized(const InfluenceMapF& influenceMap, int x0, int y0);
     void renderMatrix1BPP(const char* bytes, int w_mat, int h_mat, int off_x, int off_y, int px_w, int px_h);
     void renderMatrix8BPPHeightMap(const char* bytes, int w_mat, int h_mat, int off_x, int off_y, int px_w, int px_h);
     void renderMatrix8BPPPlayers(const char* bytes, int w_mat, int h_mat, int off_x, int off_y, int px_w, int px_h);
@@ -0,0 +1,319 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+/** A SIMD register with elements of type T.
+ * The primary template is the scalar fallback with a single element, it is also used for the remainder at the end of arrays.
+ * SimdVec<float> and SimdVec<double> are specialized to use AVX registers if the code is compiled with AVX support (e.g. -mavx2)
+ * and SSE2 registers otherwise (which all x86-64 CPUs support).
+ *
+ * The element-wise operations give exactly the same results as the scalar code, including how NaN values are handled.
+ * Sums may differ slightly because the elements are added in a different order.
+ */
+template<class T, bool Vectorized = true>
+struct SimdVec {
+    typedef bool Mask;
+    static const int Width = 1;
+    T v;
+
+    static SimdVec load(const T* p) { return { *p }; }
+    static SimdVec set1(T x) { return { x }; }
+    void store(T* p) const { *p = v; }
+
+    static SimdVec add(SimdVec a, SimdVec b) { return { a.v + b.v }; }
+    static SimdVec sub(SimdVec a, SimdVec b) { return { a.v - b.v }; }
+    static SimdVec mul(SimdVec a, SimdVec b) { return { a.v * b.v }; }
+    static SimdVec div(SimdVec a, SimdVec b) { return { a.v / b.v }; }
+    /** Returns a if a > b and b otherwise (in particular b if either value is NaN) */
+    static SimdVec max(SimdVec a, SimdVec b) { return { a.v > b.v ? a.v : b.v }; }
+
+    static Mask equal(SimdVec a, SimdVec b) { return a.v == b.v; }
+    static Mask greater(SimdVec a, SimdVec b) { return a.v > b.v; }
+    static Mask greaterEqual(SimdVec a, SimdVec b) { return a.v >= b.v; }
+    static Mask isNan(SimdVec a) { return a.v != a.v; }
+    static Mask isFinite(SimdVec a) { return a.v - a.v == 0; }
+    /** Returns a where the mask is set and b otherwise */
+    static SimdVec select(Mask m, SimdVec a, SimdVec b) { return m ? a : b; }
+
+    double horizontalSum() const { return v; }
+    T horizontalMax(T initial) const { return v > initial ? v : initial; }
+};
+
+#if defined(__AVX__)
+
+template<>
+struct SimdVec<float, true> {
+    typedef __m256 Mask;
+    static const int Width = 8;
+    __m256 v;
+
+    static SimdVec load(const float* p) { return { _mm256_loadu_ps(p) }; }
+    static SimdVec set1(float x) { return { _mm256_set1_ps(x) }; }
+    void store(float* p) const { _mm256_storeu_ps(p, v); }
+
+    static SimdVec add(SimdVec a, SimdVec b) { return { _mm256_add_ps(a.v, b.v) }; }
+    static SimdVec sub(SimdVec a, SimdVec b) { return { _mm256_sub_ps(a.v, b.v) }; }
+    static SimdVec mul(SimdVec a, SimdVec b) { return { _mm256_mul_ps(a.v, b.v) }; }
+    static SimdVec div(SimdVec a, SimdVec b) { return { _mm256_div_ps(a.v, b.v) }; }
+    static SimdVec max(SimdVec a, SimdVec b) { return { _mm256_max_ps(a.v, b.v) }; }
+
+    static Mask equal(SimdVec a, SimdVec b) { return _mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ); }
+    static Mask greater(SimdVec a, SimdVec b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); }
+    static Mask greaterEqual(SimdVec a, SimdVec b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ); }
+    static Mask isNan(SimdVec a) { return _mm256_cmp_ps(a.v, a.v, _CMP_UNORD_Q); }
+    static Mask isFinite(SimdVec a) { return _mm256_cmp_ps(_mm256_sub_ps(a.v, a.v), _mm256_setzero_ps(), _CMP_EQ_OQ); }
+    static SimdVec select(Mask m, SimdVec a, SimdVec b) { return { _mm256_blendv_ps(b.v, a.v, m) }; }
+
+    double horizontalSum() const {
+        float values[Width];
+        _mm256_storeu_ps(values, v);
+        double result = 0;
+        for (float x : values) result += x;
+        return result;
+    }
+
+    float horizontalMax(float initial) const {
+        float values[Width];
+        _mm256_storeu_ps(values, v);
+        for (float x : values) initial = x > initial ? x : initial;
+        return initial;
+    }
+};
+
+template<>
+struct SimdVec<double, true> {
+    typedef __m256d Mask;
+    static const int Width = 4;
+    __m256d v;
+
+    static SimdVec load(const double* p) { return { _mm256_loadu_pd(p) }; }
+    static SimdVec set1(double x) { return { _mm256_set1_pd(x) }; }
+    void store(double* p) const { _mm256_storeu_pd(p, v); }
+
+    static SimdVec add(SimdVec a, SimdVec b) { return { _mm256_add_pd(a.v, b.v) }; }
+    static SimdVec sub(SimdVec a, SimdVec b) { return { _mm256_sub_pd(a.v, b.v) }; }
+    static SimdVec mul(SimdVec a, SimdVec b) { return { _mm256_mul_pd(a.v, b.v) }; }
+    static SimdVec div(SimdVec a, SimdVec b) { return { _mm256_div_pd(a.v, b.v) }; }
+    static SimdVec max(SimdVec a, SimdVec b) { return { _mm256_max_pd(a.v, b.v) }; }
+
+    static Mask equal(SimdVec a, SimdVec b) { return _mm256_cmp_pd(a.v, b.v, _CMP_EQ_OQ); }
+    static Mask greater(SimdVec a, SimdVec b) { return _mm256_cmp_pd(a.v, b.v, _CMP_GT_OQ); }
+    static Mask greaterEqual(SimdVec a, SimdVec b) { return _mm256_cmp_pd(a.v, b.v, _CMP_GE_OQ); }
+    static Mask isNan(SimdVec a) { return _mm256_cmp_pd(a.v, a.v, _CMP_UNORD_Q); }
+    static Mask isFinite(SimdVec a) { return _mm256_cmp_pd(_mm256_sub_pd(a.v, a.v), _mm256_setzero_pd(), _CMP_EQ_OQ); }
+    static SimdVec select(Mask m, SimdVec a, SimdVec b) { return { _mm256_blendv_pd(b.v, a.v, m) }; }
+
+    double horizontalSum() const {
+        double values[Width];
+        _mm256_storeu_pd(values, v);
+        return values[0] + values[1] + values[2] + values[3];
+    }
+
+    double horizontalMax(double initial) const {
+        double values[Width];
+        _mm256_storeu_pd(values, v);
+        for (double x : values) initial = x > initial ? x : initial;
+        return initial;
+    }
+};
+
+#elif defined(__SSE2__) || defined(_M_X64)
+
+template<>
+struct SimdVec<float, true> {
+    typedef __m128 Mask;
+    static const int Width = 4;
+    __m128 v;
+
+    static SimdVec load(const float* p) { return { _mm_loadu_ps(p) }; }
+    static SimdVec set1(float x) { return { _mm_set1_ps(x) }; }
+    void store(float* p) const { _mm_storeu_ps(p, v); }
+
+    static SimdVec add(SimdVec a, SimdVec b) { return { _mm_add_ps(a.v, b.v) }; }
+    static SimdVec sub(SimdVec a, SimdVec b) { return { _mm_sub_ps(a.v, b.v) }; }
+    static SimdVec mul(SimdVec a, SimdVec b) { return { _mm_mul_ps(a.v, b.v) }; }
+    static SimdVec div(SimdVec a, SimdVec b) { return { _mm_div_ps(a.v, b.v) }; }
+    static SimdVec max(SimdVec a, SimdVec b) { return { _mm_max_ps(a.v, b.v) }; }
+
+    static Mask equal(SimdVec a, SimdVec b) { return _mm_cmpeq_ps(a.v, b.v); }
+    static Mask greater(SimdVec a, SimdVec b) { return _mm_cmpgt_ps(a.v, b.v); }
+    static Mask greaterEqual(SimdVec a, SimdVec b) { return _mm_cmpge_ps(a.v, b.v); }
+    static Mask isNan(SimdVec a) { return _mm_cmpunord_ps(a.v, a.v); }
+    static Mask isFinite(SimdVec a) { return _mm_cmpeq_ps(_mm_sub_ps(a.v, a.v), _mm_setzero_ps()); }
+    static SimdVec select(Mask m, SimdVec a, SimdVec b) { return { _mm_or_ps(_mm_and_ps(m, a.v), _mm_andnot_ps(m, b.v)) }; }
+
+    double horizontalSum() const {
+        float values[Width];
+        _mm_storeu_ps(values, v);
+        return (double)values[0] + values[1] + values[2] + values[3];
+    }
+
+    float horizontalMax(float initial) const {
+        float values[Width];
+        _mm_storeu_ps(values, v);
+        for (float x : values) initial = x > initial ? x : initial;
+        return initial;
+    }
+};
+
+template<>
+struct SimdVec<double, true> {
+    typedef __m128d Mask;
+    static const int Width = 2;
+    __m128d v;
+
+    static SimdVec load(const double* p) { return { _mm_loadu_pd(p) }; }
+    static SimdVec set1(double x) { return { _mm_set1_pd(x) }; }
+    void store(double* p) const { _mm_storeu_pd(p, v); }
+
+    static SimdVec add(SimdVec a, SimdVec b) { return { _mm_add_pd(a.v, b.v) }; }
+    static SimdVec sub(SimdVec a, SimdVec b) { return { _mm_sub_pd(a.v, b.v) }; }
+    static SimdVec mul(SimdVec a, SimdVec b) { return { _mm_mul_pd(a.v, b.v) }; }
+    static SimdVec div(SimdVec a, SimdVec b) { return { _mm_div_pd(a.v, b.v) }; }
+    static SimdVec max(SimdVec a, SimdVec b) { return { _mm_max_pd(a.v, b.v) }; }
+
+    static Mask equal(SimdVec a, SimdVec b) { return _mm_cmpeq_pd(a.v, b.v); }
+    static Mask greater(SimdVec a, SimdVec b) { return _mm_cmpgt_pd(a.v, b.v); }
+    static Mask greaterEqual(SimdVec a, SimdVec b) { return _mm_cmpge_pd(a.v, b.v); }
+    static Mask isNan(SimdVec a) { return _mm_cmpunord_pd(a.v, a.v); }
+    static Mask isFinite(SimdVec a) { return _mm_cmpeq_pd(_mm_sub_pd(a.v, a.v), _mm_setzero_pd()); }
+    static SimdVec select(Mask m, SimdVec a, SimdVec b) { return { _mm_or_pd(_mm_and_pd(m, a.v), _mm_andnot_pd(m, b.v)) }; }
+
+    double horizontalSum() const {
+        double values[Width];
+        _mm_storeu_pd(values, v);
+        return values[0] + values[1];
+    }
+
+    double horizontalMax(double initial) const {
+        double values[Width];
+        _mm_storeu_pd(values, v);
+        for (double x : values) initial = x > initial ? x : initial;
+        return initial;
+    }
+};
+
+#endif
+
+/** Calls fn(SimdVec<T>(), i) for each block of elements that fits in a SIMD register,
+ * and then fn(SimdVec<T, false>(), i) for each remaining element.
+ * The function is usually a generic lambda that uses the type of the first parameter to pick the register type.
+ */
+template<class T, class Fn>
+inline void simdLoop(int n, Fn fn) {
+    typedef SimdVec<T> V;
+    int i = 0;
+    for (; i + V::Width <= n; i += V::Width) fn(V(), i);
+    for (; i < n; i++) fn(SimdVec<T, false>(), i);
+}
+
+/** Vectorized kernels for operations on arrays of floats or doubles.
+ * Output arrays may be the same as the input arrays (but they may not overlap partially).
+ */
+template<class T>
+struct SimdOps {
+    static void add(T* out, const T* a, const T* b, int n) {
+        simdLoop<T>(n, [=](auto tag, int i) { typedef decltype(tag) V; V::add(V::load(a + i), V::load(b + i)).store(out + i); });
+    }
+
+    static void subtract(T* out, const T* a, const T* b, int n) {
+        simdLoop<T>(n, [=](auto tag, int i) { typedef decltype(tag) V; V::sub(V::load(a + i), V::load(b + i)).store(out + i); });
+    }
+
+    static void multiply(T* out, const T* a, const T* b, int n) {
+        simdLoop<T>(n, [=](auto tag, int i) { typedef decltype(tag) V; V::mul(V::load(a + i), V::load(b + i)).store(out + i); });
+    }
+
+    static void divide(T* out, const T* a, const T* b, int n) {
+        simdLoop<T>(n, [=](auto tag, int i) { typedef decltype(tag) V; V::div(V::load(a + i), V::load(b + i)).store(out + i); });
+    }
+
+    static void addScalar(T* out, const T* a, T b, int n) {
+        simdLoop<T>(n, [=](auto tag, int i) { typedef decltype(tag) V; V::add(V::load(a + i), V::set1(b)).store(out + i); });
+    }
+
+    static void multiplyScalar(T* out, const T* a, T b, int n) {
+        simdLoop<T>(n, [=](auto tag, int i) { typedef decltype(tag) V; V::mul(V::load(a + i), V::set1(b)).store(out + i); });
+    }
+
+    /** out = a*b + c */
+    static void multiplyAdd(T* out, const T* a, const T* b, const T* c, int n) {
+        simdLoop<T>(n, [=](auto tag, int i) { typedef decltype(tag) V; V::add(V::mul(V::load(a + i), V::load(b + i)), V::load(c + i)).store(out + i); });
+    }
+
+    /** out = a*factor + c */
+    static void multiplyScalarAdd(T* out, const T* a, T factor, const T* c, int n) {
+        simdLoop<T>(n, [=](auto tag, int i) { typedef decltype(tag) V; V::add(V::mul(V::load(a + i), V::set1(factor)), V::load(c + i)).store(out + i); });
+    }
+
+    /** out = a*factor + offset */
+    static void multiplyScalarAddScalar(T* out, const T* a, T factor, T offset, int n) {
+        simdLoop<T>(n, [=](auto tag, int i) { typedef decltype(tag) V; V::add(V::mul(V::load(a + i), V::set1(factor)), V::set1(offset)).store(out + i); });
+    }
+
+    /** Element-wise maximum. Same as std::max(a, b), so if b is NaN the result is a and if a is NaN the result is NaN */
+    static void maximum(T* out, const T* a, const T* b, int n) {
+        simdLoop<T>(n, [=](auto tag, int i) { typedef decltype(tag) V; V::max(V::load(b + i), V::load(a + i)).store(out + i); });
+    }
+
+    /** out = a >= value ? 1 : 0 */
+    static void threshold(T* out, const T* a, T value, int n) {
+        simdLoop<T>(n, [=](auto tag, int i) { typedef decltype(tag) V; V::select(V::greaterEqual(V::load(a + i), V::set1(value)), V::set1(1), V::set1(0)).store(out + i); });
+    }
+
+    /** out = isnan(a) ? with : a */
+    static void replaceNan(T* out, const T* a, T with, int n) {
+        simdLoop<T>(n, [=](auto tag, int i) { typedef decltype(tag) V; auto x = V::load(a + i); V::select(V::isNan(x), V::set1(with), x).store(out + i); });
+    }
+
+    /** Sum of all elements.
+     * Elements are summed in blocks in the SIMD registers and the block sums are accumulated in double precision,
+     * so that the result is accurate even for large float arrays.
+     */
+    static double sum(const T* a, int n) {
+        typedef SimdVec<T> V;
+        const int BlockSize = 1024;
+        double result = 0;
+        int i = 0;
+        while (i + V::Width <= n) {
+            V acc = V::set1(0);
+            int end = std::min(n - V::Width + 1, i + BlockSize);
+            for (; i < end; i += V::Width) acc = V::add(acc, V::load(a + i));
+            result += acc.horizontalSum();
+        }
+        for (; i < n; i++) result += a[i];
+        return result;
+    }
+
+    /** Largest element, or initial if it is larger than all elements. NaN values are ignored */
+    static T max(const T* a, int n, T initial) {
+        typedef SimdVec<T> V;
+        V acc = V::set1(initial);
+        int i = 0;
+        for (; i + V::Width <= n; i += V::Width) acc = V::max(V::load(a + i), acc);
+        T result = acc.horizontalMax(initial);
+        for (; i < n; i++) result = a[i] > result ? a[i] : result;
+        return result;
+    }
+
+    /** Largest finite element, or initial if it is larger than all finite elements */
+    static T maxFinite(const T* a, int n, T initial) {
+        typedef SimdVec<T> V;
+        V init = V::set1(initial);
+        V acc = init;
+        int i = 0;
+        for (; i + V::Width <= n; i += V::Width) {
+            V x = V::load(a + i);
+            acc = V::max(V::select(V::isFinite(x), x, init), acc);
+        }
+        T result = acc.horizontalMax(initial);
+        for (; i < n; i++) result = std::isfinite(a[i]) && a[i] > result ? a[i] : result;
+        return result;
+    }
+};
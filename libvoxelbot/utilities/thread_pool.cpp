@@ -0,0 +1,95 @@
+#include <libvoxelbot/utilities/thread_pool.h>
+#include <algorithm>
+#include <cassert>
+
+using namespace std;
+
+// True while the current thread is executing a loop body.
+// Used to run nested loops serially instead of deadlocking the pool.
+static thread_local bool insideParallelFor = false;
+
+ThreadPool::ThreadPool(int threads) : nextIndex(0) {
+    if (threads <= 0) threads = max(1u, thread::hardware_concurrency());
+
+    for (int i = 0; i < threads - 1; i++) {
+        workers.emplace_back([this]() { workerLoop(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeWorkers.notify_all();
+    for (auto& worker : workers) worker.join();
+}
+
+void ThreadPool::runChunks(const function<void(int)>& body, int count, int chunkSize) {
+    insideParallelFor = true;
+    while (true) {
+        int start = nextIndex.fetch_add(chunkSize);
+        if (start >= count) break;
+
+        int end = min(count, start + chunkSize);
+        for (int i = start; i < end; i++) body(i);
+    }
+    insideParallelFor = false;
+}
+
+void ThreadPool::workerLoop() {
+    uint64_t lastJob = 0;
+    while (true) {
+        const function<void(int)>* currentJob;
+        int count;
+        int chunkSize;
+        {
+            unique_lock<std::mutex> lock(mutex);
+            wakeWorkers.wait(lock, [&]() { return stopping || jobCounter != lastJob; });
+            if (stopping) return;
+
+            lastJob = jobCounter;
+            currentJob = job;
+            count = jobSize;
+            chunkSize = jobChunkSize;
+        }
+
+        runChunks(*currentJob, count, chunkSize);
+
+        {
+            lock_guard<std::mutex> lock(mutex);
+            busyWorkers--;
+        }
+        jobDone.notify_one();
+    }
+}
+
+void ThreadPool::parallelFor(int count, const function<void(int)>& body) {
+    if (count <= 0) return;
+
+    if (workers.empty() || insideParallelFor || count == 1) {
+        for (int i = 0; i < count; i++) body(i);
+        return;
+    }
+
+    {
+        lock_guard<std::mutex> lock(mutex);
+        assert(job == nullptr);
+        job = &body;
+        jobSize = count;
+        // Use several chunks per thread so that threads which finish early can take over work from slower ones
+        jobChunkSize = max(1, count / (size() * 4));
+        nextIndex = 0;
+        busyWorkers = workers.size();
+        jobCounter++;
+    }
+    wakeWorkers.notify_all();
+
+    runChunks(body, count, jobChunkSize);
+
+    {
+        unique_lock<std::mutex> lock(mutex);
+        jobDone.wait(lock, [&]() { return busyWorkers == 0; });
+        job = nullptr;
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** A small pool of worker threads used to run data parallel loops.
+ *
+ * Work is handed out in small chunks from a shared counter, so threads that finish their work early
+ * will keep taking (stealing) chunks from the remaining range instead of sitting idle.
+ * The thread that calls #parallelFor participates in the work as well.
+ */
+struct ThreadPool {
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wakeWorkers;
+    std::condition_variable jobDone;
+
+    // The currently running job (if any)
+    const std::function<void(int)>* job = nullptr;
+    int jobSize = 0;
+    int jobChunkSize = 1;
+    std::atomic<int> nextIndex;
+    // Number of workers that are still working on the current job
+    int busyWorkers = 0;
+    // Incremented for every new job so that workers can tell new jobs from spurious wakeups
+    uint64_t jobCounter = 0;
+    bool stopping = false;
+
+    void workerLoop();
+    void runChunks(const std::function<void(int)>& body, int count, int chunkSize);
+
+public:
+    /** Creates a pool which runs loops on the given number of threads in total (including the calling thread).
+     * A value of 0 or lower will use the number of hardware threads.
+     */
+    explicit ThreadPool(int threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /** Total number of threads that work on a loop, including the calling thread */
+    int size() const {
+        return workers.size() + 1;
+    }
+
+    /** Calls body(i) for all i in [0, count) and blocks until all calls have completed.
+     * The calls may happen in any order and on any thread.
+     * If this is called from inside a body that is already running on the pool, the loop is run serially on the calling thread.
+     */
+    void parallelFor(int count, const std::function<void(int)>& body);
+};
+
+/** Runs body(i) for all i in [0, count), either on the pool or serially if the pool is null */
+inline void parallelFor(ThreadPool* pool, int count, const std::function<void(int)>& body) {
+    if (pool != nullptr) {
+        pool->parallelFor(count, body);
+    } else {
+        for (int i = 0; i < count; i++) body(i);
+    }
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/** Mixes the bits of a 64-bit integer (the output function of the splitmix64 generator) */
+inline uint64_t splitmix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+/** Pseudo random key for a feature with a given value, used to build Zobrist style hashes.
+ * This is equivalent to looking up a random number in a table indexed by the feature and the value, but without the table.
+ * A hash is the sum of the keys for all features, which makes it possible to update it incrementally by subtracting the old key and adding the new one.
+ */
+inline uint64_t zobristKey(uint64_t feature, uint64_t value) {
+    return splitmix64(splitmix64(feature) ^ value);
+}
+
+/** A fixed size hash table from 64-bit keys to 64-bit values that can be used from several threads at the same time without any locks.
+ *
+ * Each entry stores key^data together with the data. If two threads write to the same entry at the same time the entry may end up
+ * with the key from one write and the data from the other, but then key^data will not match the key when it is looked up,
+ * so the entry is just treated as missing. Entries for different keys that map to the same slot replace each other.
+ */
+struct TranspositionTable {
+private:
+    struct Entry {
+        std::atomic<uint64_t> check;
+        std::atomic<uint64_t> data;
+    };
+
+    std::vector<Entry> entries;
+    uint64_t mask;
+
+public:
+    /** Creates a table with room for the given number of entries, rounded up to a power of two */
+    explicit TranspositionTable(size_t size) {
+        size_t capacity = 1;
+        while (capacity < size) capacity *= 2;
+        entries = std::vector<Entry>(capacity);
+        mask = capacity - 1;
+        clear();
+    }
+
+    void clear() {
+        for (auto& entry : entries) {
+            entry.check.store(0, std::memory_order_relaxed);
+            entry.data.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    /** Looks up the data for a key. Returns false if the key is not in the table */
+    bool lookup(uint64_t key, uint64_t& data) const {
+        auto& entry = entries[key & mask];
+        uint64_t check = entry.check.load(std::memory_order_relaxed);
+        data = entry.data.load(std::memory_order_relaxed);
+        // Empty entries have zero data, which is never stored
+        return data != 0 && (check ^ data) == key;
+    }
+
+    /** Stores the data for a key, replacing any other key in the same slot. The data must not be zero */
+    void store(uint64_t key, uint64_t data) {
+        auto& entry = entries[key & mask];
+        entry.check.store(key ^ data, std::memory_order_relaxed);
+        entry.data.store(data, std::memory_order_relaxed);
+    }
+
+    /** True if the state with the given key has been recorded as reached at the given time or earlier */
+    bool reachedBy(uint64_t key, float time) const {
+        uint64_t data;
+        if (!lookup(key, data)) return false;
+
+        float bestTime;
+        uint32_t bits = (uint32_t)data;
+        memcpy(&bestTime, &bits, sizeof(float));
+        return bestTime <= time;
+    }
+
+    /** Records that the state with the given key has been reached at the given time.
+     * Returns false if the state has already been reached at the same time or earlier, in which case it can be pruned.
+     */
+    bool improveBestTime(uint64_t key, float time) {
+        if (reachedBy(key, time)) return false;
+
+        uint32_t bits;
+        memcpy(&bits, &time, sizeof(float));
+        // The high bit makes sure the data is never zero
+        store(key, (1ULL << 32) | bits);
+        return true;
+    }
+};